@@ -0,0 +1,59 @@
+/*
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include <QImage>
+#include <QTest>
+
+#include "imagecolorsengine.h"
+
+// The per-pixel cost of sampling an image for its palette
+class ImageColorsBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        m_image = QImage(QFINDTESTDATA("../logo.png")).convertToFormat(QImage::Format_ARGB32);
+        QVERIFY(!m_image.isNull());
+    }
+
+    // What sampling used to do for every pixel: compute the chroma exactly
+    void benchmark_exactChroma()
+    {
+        int colorful = 0;
+        QBENCHMARK {
+            colorful = 0;
+            for (int y = 0; y < m_image.height(); ++y) {
+                const QRgb *line = reinterpret_cast<const QRgb *>(m_image.constScanLine(y));
+                for (int x = 0; x < m_image.width(); ++x) {
+                    if (qAlpha(line[x]) != 0 && ColorUtils::chroma(QColor::fromRgb(line[x])) >= 20) {
+                        ++colorful;
+                    }
+                }
+            }
+        }
+        QVERIFY(colorful > 0);
+    }
+
+    // Sampling with the chroma table, the histogram keeps the rest of the work small
+    void benchmark_sampling()
+    {
+        PaletteWorkspace workspace;
+        ImageData imageData;
+        QBENCHMARK {
+            imageData = ImageColorsEngine::generatePalette(m_image, ImageColorsEngine::Histogram, {}, &workspace);
+        }
+        QVERIFY(!imageData.m_palette.isEmpty());
+    }
+
+private:
+    QImage m_image;
+};
+
+QTEST_GUILESS_MAIN(ImageColorsBenchmark)
+
+#include "benchmark_imagecolors.moc"
@@ -0,0 +1,167 @@
+/*
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include <QQmlComponent>
+#include <QQmlEngine>
+#include <QQuickItem>
+#include <QTest>
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+
+#include "platformtheme.h"
+
+using namespace Kirigami::Platform;
+
+// Counts the allocations of the whole process, sizeof(PlatformThemePrivate)
+// itself is checked where it is defined.
+static std::atomic<qint64> s_allocations = 0;
+static std::atomic<qint64> s_allocatedBytes = 0;
+
+void *operator new(std::size_t size)
+{
+    ++s_allocations;
+    s_allocatedBytes += size;
+    if (void *pointer = std::malloc(size ? size : 1)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+// The cost of the themes of many items, with few or no local color overrides
+class PlatformThemeBenchmark : public QObject
+{
+    Q_OBJECT
+
+    static constexpr int ItemCount = 1000;
+
+    struct Cost {
+        double allocations = 0;
+        double bytes = 0;
+    };
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        // Registers the attached Theme type
+        m_engine.addImportPath(QStringLiteral(KIRIGAMI_IMPORT_PATH));
+        QQmlComponent component(&m_engine);
+        component.setData("import org.kde.kirigami.platform\nQtObject {}", QUrl());
+        std::unique_ptr<QObject> object(component.create());
+        QVERIFY2(object, qPrintable(component.errorString()));
+    }
+
+    void test_allocations()
+    {
+        const Cost none = themeCost(0, false);
+        const Cost one = themeCost(1, false);
+        const Cost three = themeCost(3, false);
+        const Cost nested = themeCost(0, true);
+
+        qInfo("Per theme: %.1f allocations, %.0f bytes without overrides", none.allocations, none.bytes);
+        qInfo("Per theme: %.1f allocations, %.0f bytes with 1 override", one.allocations, one.bytes);
+        qInfo("Per theme: %.1f allocations, %.0f bytes with 3 overrides", three.allocations, three.bytes);
+        qInfo("Per theme: %.1f allocations, %.0f bytes as the only child of another theme", nested.allocations, nested.bytes);
+
+        // An override is a single color in an array of the overrides, which
+        // is reallocated when one is added
+        QVERIFY(one.allocations > none.allocations);
+        QCOMPARE_LE(one.allocations - none.allocations, 1.1);
+        QCOMPARE_LE(three.allocations - none.allocations, 3.1);
+        QCOMPARE_LE(one.bytes - none.bytes, sizeof(QColor) + 16.0);
+
+        // Themes with child themes also have a list of them, the others do not
+        QCOMPARE_LE(nested.allocations - none.allocations, 2.1);
+    }
+
+    void benchmark_construction_data()
+    {
+        QTest::addColumn<int>("overrides");
+        QTest::addColumn<bool>("nested");
+
+        QTest::newRow("no overrides") << 0 << false;
+        QTest::newRow("1 override") << 1 << false;
+        QTest::newRow("3 overrides") << 3 << false;
+        QTest::newRow("nested") << 0 << true;
+    }
+
+    void benchmark_construction()
+    {
+        QFETCH(int, overrides);
+        QFETCH(bool, nested);
+
+        QBENCHMARK {
+            std::unique_ptr<QQuickItem> root(createItems(nested));
+            createThemes(root.get(), overrides);
+        }
+    }
+
+private:
+    // A root item with a theme and ItemCount items below it, either all
+    // children of the root or each the child of the previous one
+    QQuickItem *createItems(bool nested)
+    {
+        auto root = new QQuickItem;
+        QQmlEngine::setContextForObject(root, m_engine.rootContext());
+        qmlAttachedPropertiesObject<PlatformTheme>(root, true);
+
+        QQuickItem *parent = root;
+        for (int i = 0; i < ItemCount; ++i) {
+            auto item = new QQuickItem(parent);
+            item->setParentItem(parent);
+            QQmlEngine::setContextForObject(item, m_engine.rootContext());
+            if (nested) {
+                parent = item;
+            }
+        }
+        return root;
+    }
+
+    void createThemes(QQuickItem *root, int overrides)
+    {
+        const auto items = root->findChildren<QQuickItem *>();
+        for (QQuickItem *item : items) {
+            auto theme = qobject_cast<PlatformTheme *>(qmlAttachedPropertiesObject<PlatformTheme>(item, true));
+            if (overrides > 0) {
+                theme->setCustomTextColor(Qt::red);
+            }
+            if (overrides > 1) {
+                theme->setCustomBackgroundColor(Qt::blue);
+            }
+            if (overrides > 2) {
+                theme->setCustomHighlightColor(Qt::green);
+            }
+        }
+    }
+
+    Cost themeCost(int overrides, bool nested)
+    {
+        std::unique_ptr<QQuickItem> root(createItems(nested));
+
+        const qint64 allocations = s_allocations;
+        const qint64 bytes = s_allocatedBytes;
+        createThemes(root.get(), overrides);
+        return {double(s_allocations - allocations) / ItemCount, double(s_allocatedBytes - bytes) / ItemCount};
+    }
+
+    QQmlEngine m_engine;
+};
+
+QTEST_MAIN(PlatformThemeBenchmark)
+
+#include "benchmark_platformtheme.moc"
@@ -92,10 +92,19 @@ TestCase {
         }
     }
 
-    function test_extractColors(): void {
+    function test_extractColors_data() {
+        return [
+            { tag: "clustering", quantizer: Kirigami.ImageColors.Clustering },
+            { tag: "histogram", quantizer: Kirigami.ImageColors.Histogram },
+        ];
+    }
+
+    function test_extractColors(data): void {
         const item = createTemporaryObject(colorsComponent, testCase);
         const { colorArea, imageColors, paletteChangedSpy } = item;
 
+        imageColors.quantizer = data.quantizer;
+        paletteChangedSpy.clear();
         colorArea.color = Qt.rgba(1, 0, 0);
         imageColors.update();
         paletteChangedSpy.wait();
@@ -109,6 +118,44 @@ TestCase {
         compare(imageColors.palette[0], item.swatch);
     }
 
+    function test_unchangedContents(): void {
+        const item = createTemporaryObject(colorsComponent, testCase);
+        const { colorArea, imageColors, paletteChangedSpy } = item;
+
+        colorArea.color = Qt.rgba(0, 1, 0);
+        imageColors.update();
+        tryCompare(imageColors, "dominant", colorArea.color);
+
+        // Grabbing the same contents again does not compute the palette again
+        paletteChangedSpy.clear();
+        imageColors.update();
+        imageColors.update();
+        wait(200);
+        compare(paletteChangedSpy.count, 0);
+
+        colorArea.color = Qt.rgba(0, 0, 1);
+        imageColors.update();
+        paletteChangedSpy.wait();
+        compare(paletteChangedSpy.count, 1);
+        compare(imageColors.dominant, colorArea.color);
+    }
+
+    function test_progressive(): void {
+        const item = createTemporaryObject(colorsComponent, testCase);
+        const { colorArea, imageColors, paletteChangedSpy } = item;
+
+        imageColors.progressive = true;
+        paletteChangedSpy.clear();
+        colorArea.color = Qt.rgba(1, 1, 0);
+        imageColors.update();
+        tryCompare(imageColors, "dominant", colorArea.color);
+
+        // The complete palette of a uniform color is the same as the coarse one
+        wait(200);
+        compare(paletteChangedSpy.count, 1);
+        compare(imageColors.palette.length, 1);
+    }
+
     function test_invisibleWindow(): void {
         // Do not attempt to grabToImage on an item whose window is invisible.
         failOnWarning(/.?/);
@@ -0,0 +1,87 @@
+/*
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+import QtQuick
+import QtTest
+import org.kde.kirigami as Kirigami
+
+TestCase {
+    id: testCase
+    name: "ImageColorsModelTest"
+
+    width: 400
+    height: 400
+    visible: true
+
+    when: windowShown
+
+    Component {
+        id: repeaterComponent
+        Repeater {
+            model: Kirigami.ImageColorsModel {
+                sourceModel: ListModel {
+                    id: listModel
+                }
+                sourceRole: "url"
+            }
+
+            readonly property alias listModel: listModel
+
+            delegate: Item {
+                required property string url
+                required property var palette
+                required property var dominant
+            }
+        }
+    }
+
+    function test_roles(): void {
+        const repeater = createTemporaryObject(repeaterComponent, testCase);
+        const { listModel } = repeater;
+
+        listModel.append({ url: Qt.resolvedUrl("stop-icon.svg").toString() });
+        listModel.append({ url: Qt.resolvedUrl("stop-icon.svg").toString() });
+        listModel.append({ url: Qt.resolvedUrl("does-not-exist.png").toString() });
+        compare(repeater.count, 3);
+
+        // Computed asynchronously
+        tryVerify(() => repeater.itemAt(0).palette !== undefined);
+        tryVerify(() => repeater.itemAt(1).palette !== undefined);
+        tryVerify(() => repeater.itemAt(2).palette !== undefined);
+
+        // Nothing to extract from a missing file
+        compare(repeater.itemAt(2).palette.length, 0);
+        compare(repeater.itemAt(2).dominant, undefined);
+
+        // Rows with the same image share the palette
+        compare(repeater.itemAt(0).palette, repeater.itemAt(1).palette);
+        compare(repeater.itemAt(0).dominant, repeater.itemAt(1).dominant);
+    }
+
+    function test_quantizer(): void {
+        const repeater = createTemporaryObject(repeaterComponent, testCase);
+        const { listModel } = repeater;
+
+        repeater.model.quantizer = Kirigami.ImageColors.Histogram;
+        compare(repeater.model.quantizer, Kirigami.ImageColors.Histogram);
+
+        listModel.append({ url: Qt.resolvedUrl("stop-icon.svg").toString() });
+        tryVerify(() => repeater.itemAt(0).palette !== undefined);
+    }
+
+    function test_removeRows(): void {
+        const repeater = createTemporaryObject(repeaterComponent, testCase);
+        const { listModel } = repeater;
+
+        // Rows removed before their palette is available are forgotten
+        listModel.append({ url: Qt.resolvedUrl("stop-icon.svg").toString() });
+        listModel.remove(0);
+        compare(repeater.count, 0);
+
+        listModel.append({ url: Qt.resolvedUrl("stop-icon.svg").toString() });
+        tryVerify(() => repeater.itemAt(0).palette !== undefined);
+    }
+}
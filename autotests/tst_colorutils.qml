@@ -37,5 +37,152 @@ TestCase {
         fuzzyCompare(result.b, expected.b, 0.001, "Colors are not the same, Actual: " + result + " Expected: " + expected + ", component is blue")
         fuzzyCompare(result.a, expected.a, 0.001, "Colors are not the same, Actual: " + result + " Expected: " + expected + ", component is alpha")
     }
-}
 
+    function test_cache() {
+        const from = Qt.color("#af384c")
+        const expected = Kirigami.ColorUtils.linearInterpolation(from, "white", 0.15)
+
+        Kirigami.ColorUtils.setCacheEnabled(true)
+        verify(Kirigami.ColorUtils.isCacheEnabled())
+        const hits = Kirigami.ColorUtils.cacheHits()
+        compare(Kirigami.ColorUtils.linearInterpolation(from, "white", 0.15), expected)
+        compare(Kirigami.ColorUtils.linearInterpolation(from, "white", 0.15), expected)
+        verify(Kirigami.ColorUtils.cacheHits() > hits)
+
+        // Other arguments are not mixed up with the cached ones
+        compare(Kirigami.ColorUtils.linearInterpolation(from, "white", 0.5),
+                Kirigami.ColorUtils.linearInterpolation(from, "white", 0.5))
+        verify(!Qt.colorEqual(Kirigami.ColorUtils.linearInterpolation(from, "white", 0.5), expected))
+        compare(Kirigami.ColorUtils.tintWithAlpha(from, "white", 0.15), Kirigami.ColorUtils.tintWithAlpha(from, "white", 0.15))
+
+        Kirigami.ColorUtils.setCacheEnabled(false)
+        const misses = Kirigami.ColorUtils.cacheMisses()
+        Kirigami.ColorUtils.alphaBlend(Qt.rgba(0, 0, 0, 0.5), "white")
+        compare(Kirigami.ColorUtils.cacheMisses(), misses)
+    }
+
+    function test_chroma_data() {
+        return [
+            {tag: "red", color: Qt.color("#ff0000"), expected: 104.5755},
+            {tag: "breeze blue", color: Qt.color("#3daee9"), expected: 40.5757},
+            {tag: "gray", color: Qt.color("#808080"), expected: 0.0},
+            // Not an 8-bit color
+            {tag: "fractional", color: Qt.rgba(0.25, 0.5, 0.75), expected: 39.3696},
+        ]
+    }
+
+    function test_chroma(data) {
+        fuzzyCompare(Kirigami.ColorUtils.chroma(data.color), data.expected, 0.01)
+    }
+
+    property Kirigami.colorAdjustment lighter: ({ value: 40, alpha: -55 })
+    property Kirigami.colorAdjustment desaturated: ({ saturation: -50 })
+
+    function test_typedAdjustments() {
+        const color = Qt.color("#3daee9")
+        compare(Kirigami.ColorUtils.adjustColor(color, lighter), Kirigami.ColorUtils.adjustColor(color, { value: 40, alpha: -55 }))
+        compare(Kirigami.ColorUtils.scaleColor(color, desaturated), Kirigami.ColorUtils.scaleColor(color, { saturation: -50 }))
+
+        lighter.value = 0
+        fuzzyCompare(Kirigami.ColorUtils.adjustColor(color, lighter).a, (255 - 55) / 255, 0.001)
+    }
+
+    function benchmark_typedAdjustments() {
+        for (let i = 0; i < 256; ++i) {
+            Kirigami.ColorUtils.scaleColor(Qt.rgba(i / 255, 0.5, 1 - i / 255), desaturated)
+        }
+    }
+
+    function test_batch() {
+        const colors = [Qt.color("#ff0000"), Qt.color("#3daee9"), Qt.color("#808080"), Qt.rgba(0.25, 0.5, 0.75)]
+        const chromas = Kirigami.ColorUtils.chromas(colors)
+        const ratios = Kirigami.ColorUtils.contrastRatios(colors, "white")
+        const luminances = Kirigami.ColorUtils.luminances(colors)
+        compare(chromas.length, colors.length)
+        compare(ratios.length, colors.length)
+        compare(luminances.length, colors.length)
+        for (let i = 0; i < colors.length; ++i) {
+            fuzzyCompare(chromas[i], Kirigami.ColorUtils.chroma(colors[i]), 0.0001)
+            fuzzyCompare(ratios[i], Kirigami.ColorUtils.contrastRatio(colors[i], "white"), 0.0001)
+            fuzzyCompare(ratios[i], 1.05 / (luminances[i] + 0.05), 0.0001)
+        }
+        compare(Kirigami.ColorUtils.chromas([]).length, 0)
+    }
+
+    function test_batchKernels() {
+        // Enough colors for the vector kernels, and a count that leaves a
+        // remainder for the scalar one. tst_colorutils_sse2 runs this again
+        // without AVX2.
+        let colors = []
+        for (let i = 0; i < 203; ++i) {
+            colors.push(i % 3 === 0 ? Qt.rgba((i % 256) / 255, ((i * 7) % 256) / 255, ((i * 13) % 256) / 255)
+                                    : Qt.rgba(i / 203, 1 - i / 406, (i % 17) / 17))
+        }
+        const background = Qt.color("#3daee9")
+        const luminances = Kirigami.ColorUtils.luminances(colors)
+        const ratios = Kirigami.ColorUtils.contrastRatios(colors, background)
+        const chromas = Kirigami.ColorUtils.chromas(colors)
+        for (let i = 0; i < colors.length; ++i) {
+            fuzzyCompare(1.05 / (luminances[i] + 0.05), Kirigami.ColorUtils.contrastRatio(colors[i], "white"), 1e-12)
+            fuzzyCompare(ratios[i], Kirigami.ColorUtils.contrastRatio(colors[i], background), 1e-12)
+            fuzzyCompare(chromas[i], Kirigami.ColorUtils.chroma(colors[i]), 1e-9)
+        }
+    }
+
+    function test_contrastRatio() {
+        fuzzyCompare(Kirigami.ColorUtils.contrastRatio("black", "white"), 21, 0.01)
+        fuzzyCompare(Kirigami.ColorUtils.contrastRatio("white", "black"), 21, 0.01)
+        fuzzyCompare(Kirigami.ColorUtils.contrastRatio("#3daee9", "#3daee9"), 1, 0.001)
+    }
+
+    function test_ensureContrast_data() {
+        return [
+            {tag: "gray on white", color: Qt.color("#aaaaaa"), background: Qt.color("white"), ratio: 4.5},
+            {tag: "blue on dark", color: Qt.color("#1d4f91"), background: Qt.color("#202326"), ratio: 3},
+            {tag: "red on mid gray", color: Qt.color("#ff0000"), background: Qt.color("#777777"), ratio: 4.5},
+            {tag: "already fine", color: Qt.color("black"), background: Qt.color("white"), ratio: 4.5},
+        ]
+    }
+
+    function test_ensureContrast(data) {
+        const result = Kirigami.ColorUtils.ensureContrast(data.color, data.background, data.ratio)
+        verify(Kirigami.ColorUtils.contrastRatio(result, data.background) >= data.ratio,
+               "Contrast of " + result + " on " + data.background + " is too low")
+        // Only the lightness changes
+        if (data.color.hslSaturation > 0 && result.hslLightness > 0 && result.hslLightness < 1) {
+            fuzzyCompare(result.hslHue, data.color.hslHue, 0.02)
+        }
+    }
+
+    function test_ensureContrastSweep() {
+        // The result must reach the ratio itself, not only before it is rounded to 8 bits
+        const ratios = [1.5, 3, 4.5, 7]
+        for (let background = 0; background < 256; background += 5) {
+            const backgroundColor = Qt.rgba(background / 255, background / 255, background / 255)
+            for (let foreground = 0; foreground < 256; foreground += 3) {
+                const colors = [Qt.rgba(foreground / 255, foreground / 255, foreground / 255),
+                                Qt.rgba(foreground / 255, 0.4, 1 - foreground / 255)]
+                for (const color of colors) {
+                    for (const ratio of ratios) {
+                        const result = Kirigami.ColorUtils.ensureContrast(color, backgroundColor, ratio)
+                        const best = Math.max(Kirigami.ColorUtils.contrastRatio("white", backgroundColor),
+                                              Kirigami.ColorUtils.contrastRatio("black", backgroundColor))
+                        verify(Kirigami.ColorUtils.contrastRatio(result, backgroundColor) >= Math.min(ratio, best),
+                               "Contrast of " + result + " (from " + color + ") on " + backgroundColor + " is below " + ratio)
+                    }
+                }
+            }
+        }
+    }
+
+    function test_ensureContrastUnreachable() {
+        // No color has a contrast ratio of 10 with a mid gray, the best is black
+        compare(Kirigami.ColorUtils.ensureContrast("#3daee9", "#777777", 10), Qt.color("black"))
+    }
+
+    function benchmark_ensureContrast() {
+        for (let i = 0; i < 256; ++i) {
+            Kirigami.ColorUtils.ensureContrast(Qt.rgba(i / 255, 0.5, 1 - i / 255), "white", 4.5)
+        }
+    }
+}
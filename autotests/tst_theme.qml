@@ -375,4 +375,314 @@ TestCase {
         compare(item.child1.color, "#2b2d2f")
         compare(item.child2.color, "#2b2d2f")
     }
+
+    Component {
+        id: reparent
+
+        Item {
+            property alias first: rect1
+            property alias second: rect2
+            property alias child: rect3
+
+            Rectangle {
+                id: rect1
+                Kirigami.Theme.inherit: false
+                Kirigami.Theme.colorSet: Kirigami.Theme.View
+                color: Kirigami.Theme.backgroundColor
+
+                Rectangle {
+                    id: rect3
+                    color: Kirigami.Theme.backgroundColor
+                }
+
+                Item {
+                    id: wrapper
+
+                    Rectangle {
+                        id: rect4
+                        color: Kirigami.Theme.backgroundColor
+                    }
+                }
+            }
+
+            Rectangle {
+                id: rect2
+                Kirigami.Theme.inherit: false
+                Kirigami.Theme.colorSet: Kirigami.Theme.Complementary
+                color: Kirigami.Theme.backgroundColor
+            }
+
+            property alias wrapper: wrapper
+            property alias grandChild: rect4
+        }
+    }
+
+    function test_reparent() {
+        var item = createTemporaryObject(reparent, testCase)
+        verify(item)
+
+        compare(item.child.color, "#fcfcfc")
+
+        item.child.parent = item.second
+        compare(item.child.color, "#31363b")
+
+        // Only the new parent affects the child
+        item.first.Kirigami.Theme.inherit = true
+        compare(item.child.color, "#31363b")
+
+        item.second.Kirigami.Theme.inherit = true
+        compare(item.child.color, item.second.color)
+        compare(item.child.Kirigami.Theme.colorSet, item.second.Kirigami.Theme.colorSet)
+
+        // Reparenting an ancestor without theme is taken into account the
+        // next time the theme updates
+        compare(item.grandChild.color, item.first.color)
+        item.second.Kirigami.Theme.inherit = false
+        item.wrapper.parent = item.second
+        item.grandChild.Kirigami.Theme.inherit = false
+        item.grandChild.Kirigami.Theme.inherit = true
+        compare(item.grandChild.color, "#31363b")
+    }
+
+    Component {
+        id: reparentCloser
+
+        Rectangle {
+            Kirigami.Theme.inherit: false
+            Kirigami.Theme.colorSet: Kirigami.Theme.View
+            color: Kirigami.Theme.backgroundColor
+
+            property alias inner: inner
+            property alias wrapper: wrapper
+            property alias grandChild: grandChild
+
+            Rectangle {
+                id: inner
+                Kirigami.Theme.inherit: false
+                Kirigami.Theme.colorSet: Kirigami.Theme.Complementary
+                color: Kirigami.Theme.backgroundColor
+            }
+
+            Item {
+                id: wrapper
+
+                Rectangle {
+                    id: grandChild
+                    color: Kirigami.Theme.backgroundColor
+                }
+            }
+        }
+    }
+
+    function test_reparentBelowCloserTheme() {
+        var item = createTemporaryObject(reparentCloser, testCase)
+        verify(item)
+
+        compare(item.grandChild.color, "#fcfcfc")
+
+        // The theme of the item is still an ancestor, but the one of inner is closer
+        item.wrapper.parent = item.inner
+        item.grandChild.Kirigami.Theme.inherit = false
+        item.grandChild.Kirigami.Theme.inherit = true
+        compare(item.grandChild.color, "#31363b")
+    }
+
+    Component {
+        id: visualParent
+
+        Rectangle {
+            Kirigami.Theme.inherit: false
+            Kirigami.Theme.colorSet: Kirigami.Theme.View
+
+            color: Kirigami.Theme.backgroundColor
+
+            property alias middle: middle
+            // Only a visual child of middle, its parent object is the root
+            property Rectangle child: Rectangle {
+                parent: middle
+                color: Kirigami.Theme.backgroundColor
+            }
+
+            Item {
+                id: middle
+            }
+        }
+    }
+
+    function test_visual_parent() {
+        var item = createTemporaryObject(visualParent, testCase)
+        verify(item)
+
+        compare(item.child.color, "#fcfcfc")
+
+        // The theme of middle is only created now, after the one of child
+        item.middle.Kirigami.Theme.inherit = false
+        item.middle.Kirigami.Theme.colorSet = Kirigami.Theme.Complementary
+        compare(item.child.color, "#31363b")
+        compare(item.color, "#fcfcfc")
+    }
+
+    Component {
+        id: middleComponent
+
+        Rectangle {
+            color: Kirigami.Theme.backgroundColor
+        }
+    }
+
+    Component {
+        id: destroyMiddle
+
+        Rectangle {
+            // Ensure the root object we test with doesn't accidentally inherit
+            // from the parent test object.
+            Kirigami.Theme.inherit: false
+            Kirigami.Theme.colorSet: Kirigami.Theme.View
+
+            color: Kirigami.Theme.backgroundColor
+
+            property alias grandChild: rect
+
+            Rectangle {
+                id: rect
+                color: Kirigami.Theme.backgroundColor
+            }
+        }
+    }
+
+    function test_destroy_middle() {
+        var item = createTemporaryObject(destroyMiddle, testCase)
+        verify(item)
+
+        var middle = middleComponent.createObject(item)
+        verify(middle)
+        item.grandChild.parent = middle
+        compare(item.grandChild.color, "#fcfcfc")
+
+        // Destroying an item leaves its child items without parent
+        middle.destroy()
+        tryCompare(item.grandChild, "parent", null)
+
+        item.grandChild.parent = item
+        item.Kirigami.Theme.colorSet = Kirigami.Theme.Complementary
+        compare(item.color, "#31363b")
+        compare(item.grandChild.color, "#31363b")
+    }
+
+    Component {
+        id: sharedData
+
+        Item {
+            property alias first: rect1
+            property alias second: rect2
+            property alias child: rect3
+
+            Rectangle {
+                id: rect1
+                Kirigami.Theme.inherit: false
+                Kirigami.Theme.colorSet: Kirigami.Theme.View
+                color: Kirigami.Theme.backgroundColor
+
+                Rectangle {
+                    id: rect3
+                    color: Kirigami.Theme.backgroundColor
+                }
+            }
+
+            Rectangle {
+                id: rect2
+                Kirigami.Theme.inherit: false
+                Kirigami.Theme.colorSet: Kirigami.Theme.View
+                color: Kirigami.Theme.backgroundColor
+            }
+        }
+    }
+
+    function test_shared_data() {
+        var item = createTemporaryObject(sharedData, testCase)
+        verify(item)
+
+        compare(item.first.color, "#fcfcfc")
+        compare(item.second.color, "#fcfcfc")
+        compare(item.child.color, "#fcfcfc")
+
+        // Themes with the same colorSet share their data, but changing one of
+        // them does not affect the others.
+        item.first.Kirigami.Theme.colorSet = Kirigami.Theme.Complementary
+        compare(item.first.color, "#31363b")
+        compare(item.child.color, "#31363b")
+        compare(item.second.color, "#fcfcfc")
+
+        item.first.Kirigami.Theme.colorSet = Kirigami.Theme.View
+        compare(item.first.color, "#fcfcfc")
+        compare(item.child.color, "#fcfcfc")
+
+        item.second.Kirigami.Theme.backgroundColor = "#ff0000"
+        compare(item.second.color, "#ff0000")
+        compare(item.first.color, "#fcfcfc")
+        compare(item.child.color, "#fcfcfc")
+
+        // The remaining themes keep working when the others are gone
+        var other = createTemporaryObject(sharedData, testCase)
+        verify(other)
+        item.destroy()
+        wait(0)
+
+        other.first.Kirigami.Theme.colorSet = Kirigami.Theme.Complementary
+        compare(other.first.color, "#31363b")
+        compare(other.second.color, "#fcfcfc")
+
+        other.first.Kirigami.Theme.colorSet = Kirigami.Theme.View
+        compare(other.first.color, "#fcfcfc")
+        compare(other.child.color, "#fcfcfc")
+    }
+
+    Component {
+        id: batching
+
+        Rectangle {
+            // Ensure the root object we test with doesn't accidentally inherit
+            // from the parent test object.
+            Kirigami.Theme.inherit: false
+
+            color: Kirigami.Theme.backgroundColor
+
+            property alias child: rect
+
+            Rectangle {
+                id: rect
+                color: Kirigami.Theme.backgroundColor
+
+                property SignalSpy signalSpy: SignalSpy {
+                    target: rect.Kirigami.Theme
+                    signalName: "colorsChanged"
+                }
+            }
+        }
+    }
+
+    function test_change_batching() {
+        var item = createTemporaryObject(batching, testCase)
+        verify(item)
+
+        item.Kirigami.Theme.setChangeBatchingEnabled(true)
+        verify(item.Kirigami.Theme.isChangeBatchingEnabled())
+
+        item.Kirigami.Theme.colorSet = Kirigami.Theme.View
+        item.Kirigami.Theme.colorSet = Kirigami.Theme.Complementary
+
+        // The theme that changed is updated right away, the one inheriting it
+        // once all the changes are done.
+        compare(item.color, "#31363b")
+        compare(item.child.signalSpy.count, 0)
+
+        tryCompare(item.child, "color", "#31363b")
+        compare(item.child.signalSpy.count, 1)
+
+        item.Kirigami.Theme.setChangeBatchingEnabled(false)
+        verify(!item.Kirigami.Theme.isChangeBatchingEnabled())
+
+        item.Kirigami.Theme.colorSet = Kirigami.Theme.View
+        compare(item.child.color, "#fcfcfc")
+    }
 }
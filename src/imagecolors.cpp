@@ -8,112 +8,75 @@
 #include "imagecolors.h"
 
 #include <QDebug>
+#include <QFileInfo>
 #include <QFutureWatcher>
 #include <QGuiApplication>
-#include <QtConcurrentRun>
 
+#include "imagecolorscache.h"
+#include "imagecolorsjob.h"
 #include "loggingcategory.h"
-#include <cmath>
-#include <vector>
-
-#include "config-OpenMP.h"
-#if HAVE_OpenMP
-#include <omp.h>
-#endif
+#include <algorithm>
+#include <utility>
 
 #include "platform/platformtheme.h"
 
 #define return_fallback(value)                                                                                                                                 \
-    if (m_imageData.m_samples.size() == 0) {                                                                                                                   \
+    if (m_imageData.m_palette.isEmpty()) {                                                                                                                     \
         return value;                                                                                                                                          \
     }
 
 #define return_fallback_finally(value, finally)                                                                                                                \
-    if (m_imageData.m_samples.size() == 0) {                                                                                                                   \
+    if (m_imageData.m_palette.isEmpty()) {                                                                                                                     \
         return value.isValid()                                                                                                                                 \
             ? value                                                                                                                                            \
             : static_cast<Kirigami::Platform::PlatformTheme *>(qmlAttachedPropertiesObject<Kirigami::Platform::PlatformTheme>(this, true))->finally();         \
     }
 
-PaletteSwatch::PaletteSwatch()
-{
-}
-
-PaletteSwatch::PaletteSwatch(qreal ratio, const QColor &color, const QColor &contrastColor)
-    : m_ratio(ratio)
-    , m_color(color)
-    , m_contrastColor(contrastColor)
-{
-}
-
-qreal PaletteSwatch::ratio() const
-{
-    return m_ratio;
-}
-
-const QColor &PaletteSwatch::color() const
-{
-    return m_color;
-}
-
-const QColor &PaletteSwatch::contrastColor() const
-{
-    return m_contrastColor;
-}
-
-bool PaletteSwatch::operator==(const PaletteSwatch &other) const
-{
-    return m_ratio == other.m_ratio //
-        && m_color == other.m_color //
-        && m_contrastColor == other.m_contrastColor;
-}
-
 ImageColors::ImageColors(QObject *parent)
     : QObject(parent)
 {
+    m_grabTimer.setSingleShot(true);
+    connect(&m_grabTimer, &QTimer::timeout, this, &ImageColors::grab);
 }
 
 ImageColors::~ImageColors()
 {
+    if (m_futureImageData) {
+        ImageColorsCache::instance()->release(m_request);
+    }
+    if (m_futureCoarseImageData) {
+        ImageColorsCache::instance()->release(m_coarseRequest);
+    }
 }
 
 void ImageColors::setSource(const QVariant &source)
 {
-    if (m_futureSourceImageData) {
-        m_futureSourceImageData->cancel();
-        m_futureSourceImageData->deleteLater();
-        m_futureSourceImageData = nullptr;
-    }
-
     if (source.canConvert<QQuickItem *>()) {
         setSourceItem(source.value<QQuickItem *>());
     } else if (source.canConvert<QImage>()) {
         setSourceImage(source.value<QImage>());
     } else if (source.canConvert<QIcon>()) {
-        setSourceImage(source.value<QIcon>().pixmap(128, 128).toImage());
+        const QIcon icon = source.value<QIcon>();
+        setSourceIcon(icon, QStringLiteral("icon:%1:%2x%3").arg(icon.cacheKey()).arg(iconSize().width()).arg(iconSize().height()));
     } else if (source.canConvert<QString>()) {
         const QString sourceString = source.toString();
 
         if (QIcon::hasThemeIcon(sourceString)) {
-            setSourceImage(QIcon::fromTheme(sourceString).pixmap(128, 128).toImage());
+            setSourceIcon(QIcon::fromTheme(sourceString),
+                          QStringLiteral("theme:%1:%2:%3x%4")
+                              .arg(QIcon::themeName(), sourceString, QString::number(iconSize().width()), QString::number(iconSize().height())));
         } else {
-            QFuture<QImage> future = QtConcurrent::run([sourceString]() {
-                if (auto url = QUrl(sourceString); url.isLocalFile()) {
-                    return QImage(url.toLocalFile());
-                }
-                return QImage(sourceString);
-            });
-            m_futureSourceImageData = new QFutureWatcher<QImage>(this);
-            connect(m_futureSourceImageData, &QFutureWatcher<QImage>::finished, this, [this, source]() {
-                const QImage image = m_futureSourceImageData->future().result();
-                m_futureSourceImageData->deleteLater();
-                m_futureSourceImageData = nullptr;
-                setSourceImage(image);
-                m_source = source;
-                Q_EMIT sourceChanged();
-            });
-            m_futureSourceImageData->setFuture(future);
-            return;
+            QString path = sourceString;
+            if (auto url = QUrl(sourceString); url.isLocalFile()) {
+                path = url.toLocalFile();
+            }
+            setSourceLoader(
+                [path](const QSize &size) {
+                    return ImageColorsEngine::loadImage(path, size);
+                },
+                m_analysisSize,
+                fileKey(path, m_analysisSize),
+                path);
         }
     } else {
         return;
@@ -129,6 +92,53 @@ QVariant ImageColors::source() const
 }
 
 void ImageColors::setSourceImage(const QImage &image)
+{
+    setSourceImage(image, image.isNull() ? QString() : QStringLiteral("image:%1").arg(image.cacheKey()));
+}
+
+void ImageColors::setSourceIcon(const QIcon &icon, const QString &key)
+{
+    clearSourceItem();
+
+    // Rendering icons, SVG ones in particular, is expensive. Defer it to runUpdate(),
+    // so that it is skipped when the palette is cached. QIcon and QPixmap are not
+    // thread-safe, so it can't move to the palette job.
+    m_sourceImage = QImage();
+    m_sourceIcon = icon;
+    m_sourceLoader = nullptr;
+    m_sourceSize = iconSize();
+    m_sourceKey = key;
+    m_sourcePath.clear();
+    update();
+}
+
+void ImageColors::setSourceImage(const QImage &image, const QString &key)
+{
+    clearSourceItem();
+
+    m_sourceImage = image;
+    m_sourceIcon = QIcon();
+    m_sourceLoader = nullptr;
+    m_sourceSize = QSize();
+    m_sourceKey = key;
+    m_sourcePath.clear();
+    update();
+}
+
+void ImageColors::setSourceLoader(std::function<QImage(const QSize &size)> &&loader, const QSize &size, const QString &key, const QString &path)
+{
+    clearSourceItem();
+
+    m_sourceImage = QImage();
+    m_sourceIcon = QIcon();
+    m_sourceLoader = std::move(loader);
+    m_sourceSize = size;
+    m_sourceKey = key;
+    m_sourcePath = path;
+    update();
+}
+
+void ImageColors::clearSourceItem()
 {
     if (m_window) {
         disconnect(m_window.data(), nullptr, this, nullptr);
@@ -140,11 +150,11 @@ void ImageColors::setSourceImage(const QImage &image)
         disconnect(m_grabResult.data(), nullptr, this, nullptr);
         m_grabResult.clear();
     }
+    m_grabTimer.stop();
+    m_grabQueued = false;
+    m_grabbedImage = QImage();
 
     m_sourceItem.clear();
-
-    m_sourceImage = image;
-    update();
 }
 
 QImage ImageColors::sourceImage() const
@@ -152,6 +162,117 @@ QImage ImageColors::sourceImage() const
     return m_sourceImage;
 }
 
+ImageColors::Quantizer ImageColors::quantizer() const
+{
+    return m_quantizer;
+}
+
+void ImageColors::setQuantizer(Quantizer quantizer)
+{
+    if (m_quantizer == quantizer) {
+        return;
+    }
+
+    m_quantizer = quantizer;
+    Q_EMIT quantizerChanged();
+    // The contents of an item have to be processed again even if they did not change
+    m_grabbedImage = QImage();
+    update();
+}
+
+bool ImageColors::persistentCache() const
+{
+    return m_persistentCache;
+}
+
+void ImageColors::setPersistentCache(bool persistent)
+{
+    if (m_persistentCache == persistent) {
+        return;
+    }
+
+    m_persistentCache = persistent;
+    Q_EMIT persistentCacheChanged();
+
+    if (m_persistentCache && m_sourceLoader) {
+        // Make sure a palette computed before this was set ends up on disk as well
+        update();
+    }
+}
+
+int ImageColors::minimumUpdateInterval() const
+{
+    return m_minimumUpdateInterval;
+}
+
+void ImageColors::setMinimumUpdateInterval(int interval)
+{
+    if (m_minimumUpdateInterval == interval) {
+        return;
+    }
+
+    m_minimumUpdateInterval = interval;
+    Q_EMIT minimumUpdateIntervalChanged();
+}
+
+bool ImageColors::progressive() const
+{
+    return m_progressive;
+}
+
+void ImageColors::setProgressive(bool progressive)
+{
+    if (m_progressive == progressive) {
+        return;
+    }
+
+    // Applies from the next update, the palette being computed is complete anyway
+    m_progressive = progressive;
+    Q_EMIT progressiveChanged();
+}
+
+QSize ImageColors::analysisSize() const
+{
+    return m_analysisSize;
+}
+
+void ImageColors::setAnalysisSize(const QSize &size)
+{
+    if (m_analysisSize == size) {
+        return;
+    }
+
+    m_analysisSize = size;
+    Q_EMIT analysisSizeChanged();
+
+    if (m_sourceItem || !m_source.isValid()) {
+        update();
+    } else {
+        // Icons and files have to be rendered or decoded again
+        setSource(m_source);
+    }
+}
+
+QSize ImageColors::iconSize() const
+{
+    return m_analysisSize.isValid() ? m_analysisSize : QSize(128, 128);
+}
+
+QString ImageColors::fileKey(const QString &path, const QSize &analysisSize)
+{
+    // The modification time can be set to anything, e.g. by copies preserving
+    // it, the time of the last change of the metadata is set by the system
+    // whenever the file is written or replaced.
+    const QFileInfo info(path);
+    return QStringLiteral("file:%1:%2:%3:%4:%5x%6")
+        .arg(path,
+             QString::number(info.size()),
+             QString::number(info.lastModified().toMSecsSinceEpoch()),
+             QString::number(info.metadataChangeTime().toMSecsSinceEpoch()),
+             QString::number(analysisSize.width()),
+             QString::number(analysisSize.height()));
+}
+
 void ImageColors::setSourceItem(QQuickItem *source)
 {
     if (m_sourceItem == source) {
@@ -164,6 +285,12 @@ void ImageColors::setSourceItem(QQuickItem *source)
     if (m_sourceItem) {
         disconnect(m_sourceItem, nullptr, this, nullptr);
     }
+    if (m_grabResult) {
+        disconnect(m_grabResult.data(), nullptr, this, nullptr);
+        m_grabResult.clear();
+    }
+    m_grabQueued = false;
+    m_grabbedImage = QImage();
     m_sourceItem = source;
     update();
 
@@ -189,381 +316,249 @@ QQuickItem *ImageColors::sourceItem() const
     return m_sourceItem;
 }
 
-void ImageColors::update()
+QString ImageColors::cacheKey() const
 {
-    if (m_futureImageData) {
-        m_futureImageData->disconnect(this, nullptr);
-        m_futureImageData->cancel();
-        m_futureImageData->deleteLater();
-        m_futureImageData = nullptr;
+    if (m_sourceKey.isEmpty()) {
+        return QString();
     }
+    return cacheKey(m_sourceKey, m_quantizer);
+}
 
-    auto runUpdate = [this]() {
-        auto sourceImage{m_sourceImage};
-        QFuture<ImageData> future = QtConcurrent::run([sourceImage = std::move(sourceImage)]() {
-            return generatePalette(sourceImage);
-        });
-        m_futureImageData = new QFutureWatcher<ImageData>(this);
-        connect(m_futureImageData, &QFutureWatcher<ImageData>::finished, this, [this]() {
-            if (!m_futureImageData) {
-                return;
-            }
-            m_imageData = m_futureImageData->future().result();
-            postProcess(m_imageData);
-            m_futureImageData->deleteLater();
-            m_futureImageData = nullptr;
-
-            Q_EMIT paletteChanged();
-        });
-        m_futureImageData->setFuture(future);
-    };
+QString ImageColors::cacheKey(const QString &sourceKey, Quantizer quantizer)
+{
+    return sourceKey + QLatin1Char(':') + QString::number(quantizer);
+}
 
+void ImageColors::update()
+{
     if (!m_sourceItem || !m_sourceItem->window() || !m_sourceItem->window()->isVisible()) {
-        if (!m_sourceImage.isNull()) {
+        m_grabTimer.stop();
+        m_grabQueued = false;
+        if (!m_sourceImage.isNull() || !m_sourceIcon.isNull() || m_sourceLoader) {
             runUpdate();
         } else {
+            releaseRequest();
             m_imageData = {};
             Q_EMIT paletteChanged();
         }
         return;
     }
 
+    // Wait for the grab in flight, its result may be outdated already
     if (m_grabResult) {
-        disconnect(m_grabResult.data(), nullptr, this, nullptr);
-        m_grabResult.clear();
+        m_grabQueued = true;
+        return;
+    }
+
+    // Coalesce the updates requested until the next pass of the event loop
+    if (!m_grabTimer.isActive()) {
+        qint64 delay = 0;
+        if (m_minimumUpdateInterval > 0 && m_lastGrabTime.isValid()) {
+            delay = std::max<qint64>(0, m_minimumUpdateInterval - m_lastGrabTime.elapsed());
+        }
+        m_grabTimer.start(delay);
+    }
+}
+
+void ImageColors::grab()
+{
+    if (!m_sourceItem || !m_sourceItem->window() || !m_sourceItem->window()->isVisible()) {
+        return;
     }
 
-    m_grabResult = m_sourceItem->grabToImage(QSize(128, 128));
+    m_lastGrabTime.start();
+    // The grab completes with the next frame, so there is at most one per frame
+    m_grabResult = m_sourceItem->grabToImage(m_analysisSize);
 
     if (m_grabResult) {
-        connect(m_grabResult.data(), &QQuickItemGrabResult::ready, this, [this, runUpdate]() {
-            m_sourceImage = m_grabResult->image();
+        connect(m_grabResult.data(), &QQuickItemGrabResult::ready, this, [this]() {
+            const QImage image = m_grabResult->image();
             m_grabResult.clear();
-            runUpdate();
+
+            // Animated items often request updates without their contents changing
+            if (image.isNull() || image != m_grabbedImage) {
+                m_grabbedImage = image;
+                // The contents of an item can change at any time, don't cache them
+                m_sourceImage = image;
+                m_sourceIcon = QIcon();
+                m_sourceLoader = nullptr;
+                m_sourceSize = QSize();
+                m_sourceKey.clear();
+                m_sourcePath.clear();
+                runUpdate();
+            }
+
+            if (m_grabQueued) {
+                m_grabQueued = false;
+                update();
+            }
         });
     }
 }
 
-static inline int squareDistance(QRgb color1, QRgb color2)
+void ImageColors::releaseRequest()
 {
-    // https://en.wikipedia.org/wiki/Color_difference
-    // Using RGB distance for performance, as CIEDE2000 is too complicated
-    if (qRed(color1) - qRed(color2) < 128) {
-        return 2 * pow(qRed(color1) - qRed(color2), 2) //
-            + 4 * pow(qGreen(color1) - qGreen(color2), 2) //
-            + 3 * pow(qBlue(color1) - qBlue(color2), 2);
-    } else {
-        return 3 * pow(qRed(color1) - qRed(color2), 2) //
-            + 4 * pow(qGreen(color1) - qGreen(color2), 2) //
-            + 2 * pow(qBlue(color1) - qBlue(color2), 2);
+    if (m_futureImageData) {
+        m_futureImageData->disconnect(this, nullptr);
+        ImageColorsCache::instance()->release(m_request);
+        m_request = {};
+        m_futureImageData->deleteLater();
+        m_futureImageData = nullptr;
     }
+    releaseCoarseRequest();
+    m_coarse = false;
 }
 
-void ImageColors::positionColor(QRgb rgb, QList<ImageData::colorStat> &clusters)
+void ImageColors::releaseCoarseRequest()
 {
-    for (auto &stat : clusters) {
-        if (squareDistance(rgb, stat.centroid) < s_minimumSquareDistance) {
-            stat.colors.append(rgb);
-            return;
-        }
+    if (m_futureCoarseImageData) {
+        m_futureCoarseImageData->disconnect(this, nullptr);
+        ImageColorsCache::instance()->release(m_coarseRequest);
+        m_coarseRequest = {};
+        m_futureCoarseImageData->deleteLater();
+        m_futureCoarseImageData = nullptr;
     }
-
-    ImageData::colorStat stat;
-    stat.colors.append(rgb);
-    stat.centroid = rgb;
-    clusters << stat;
 }
 
-void ImageColors::positionColorMP(const decltype(ImageData::m_samples) &samples, decltype(ImageData::m_clusters) &clusters, int numCore)
+void ImageColors::runUpdate()
 {
-#if HAVE_OpenMP
-    if (samples.size() < 65536 /* 256^2 */ || numCore < 2) {
-#else
-    if (true) {
-#endif
-        // Fall back to single thread
-        for (auto color : samples) {
-            positionColor(color, clusters);
+    releaseRequest();
+
+    const QString key = cacheKey();
+    // Only files are worth keeping across restarts
+    const bool persistent = m_persistentCache && m_sourceKey.startsWith(QLatin1String("file:"));
+    if (!key.isEmpty()) {
+        if (auto imageData = ImageColorsCache::instance()->find(key, persistent)) {
+            m_imageData = *imageData;
+            postProcess(m_imageData);
+            Q_EMIT paletteChanged();
+            return;
         }
-        return;
     }
-#if HAVE_OpenMP
-    // Split the whole samples into multiple parts
-    const int numSamplesPerThread = samples.size() / numCore;
-    std::vector<decltype(ImageData::m_clusters)> tempClusters(numCore, decltype(ImageData::m_clusters){});
-#pragma omp parallel for
-    for (int i = 0; i < numCore; ++i) {
-        const auto beginIt = std::next(samples.begin(), numSamplesPerThread * i);
-        const auto endIt = i < numCore - 1 ? std::next(samples.begin(), numSamplesPerThread * (i + 1)) : samples.end();
-
-        for (auto it = beginIt; it != endIt; it = std::next(it)) {
-            positionColor(*it, tempClusters[omp_get_thread_num()]);
-        }
-    } // END omp parallel for
 
-    // Restore clusters
-    // Don't use std::as_const as memory will grow significantly
-    for (const auto &clusterPart : tempClusters) {
-        clusters << clusterPart;
+    // Rendered once, later updates (e.g. of the quantizer) reuse the image
+    if (m_sourceImage.isNull() && !m_sourceIcon.isNull()) {
+        m_sourceImage = m_sourceIcon.pixmap(m_sourceSize).toImage();
     }
-    for (int i = 0; i < clusters.size() - 1; ++i) {
-        auto &clusterA = clusters[i];
-        if (clusterA.colors.empty()) {
-            continue; // Already merged
-        }
-        for (int j = i + 1; j < clusters.size(); ++j) {
-            auto &clusterB = clusters[j];
-            if (clusterB.colors.empty()) {
-                continue; // Already merged
-            }
-            if (squareDistance(clusterA.centroid, clusterB.centroid) < s_minimumSquareDistance) {
-                // Merge colors in clusterB into clusterA
-                clusterA.colors.append(clusterB.colors);
-                clusterB.colors.clear();
-            }
-        }
-    }
-
-    auto removeIt = std::remove_if(clusters.begin(), clusters.end(), [](const ImageData::colorStat &stat) {
-        return stat.colors.empty();
-    });
-    clusters.erase(removeIt, clusters.end());
-#endif
-}
 
-ImageData ImageColors::generatePalette(const QImage &sourceImage)
-{
-    ImageData imageData;
-
-    if (sourceImage.isNull() || sourceImage.width() == 0) {
-        return imageData;
-    }
-
-    imageData.m_clusters.clear();
-    imageData.m_samples.clear();
-
-#if HAVE_OpenMP
-    static const int numCore = std::min(8, omp_get_num_procs());
-    omp_set_num_threads(numCore);
-#else
-    constexpr int numCore = 1;
-#endif
-    int r = 0;
-    int g = 0;
-    int b = 0;
-    int c = 0;
-
-#pragma omp parallel for collapse(2) reduction(+ : r) reduction(+ : g) reduction(+ : b) reduction(+ : c)
-    for (int x = 0; x < sourceImage.width(); ++x) {
-        for (int y = 0; y < sourceImage.height(); ++y) {
-            const QColor sampleColor = sourceImage.pixelColor(x, y);
-            if (sampleColor.alpha() == 0) {
-                continue;
-            }
-            if (ColorUtils::chroma(sampleColor) < 20) {
-                continue;
+    ImageColorsJob::Function job;
+    if (m_sourceLoader) {
+        job = [loader = m_sourceLoader,
+               size = m_sourceSize,
+               path = m_sourcePath,
+               analysisSize = m_analysisSize,
+               quantizer = ImageColorsEngine::Quantizer(m_quantizer)](const std::function<bool()> &isCanceled) {
+            // Palettes baked with kirigami-imagecolors
+            if (!path.isEmpty()) {
+                if (auto imageData = ImageColorsCache::instance()->findInSidecar(path, analysisSize, quantizer)) {
+                    return *imageData;
+                }
             }
-            QRgb rgb = sampleColor.rgb();
-            ++c;
-            r += qRed(rgb);
-            g += qGreen(rgb);
-            b += qBlue(rgb);
-#pragma omp critical
-            imageData.m_samples << rgb;
-        }
-    } // END omp parallel for
-
-    if (imageData.m_samples.isEmpty()) {
-        return imageData;
+            return ImageColorsEngine::generatePalette(loader(size), quantizer, isCanceled);
+        };
+    } else {
+        job = [sourceImage = m_sourceImage, quantizer = m_quantizer](const std::function<bool()> &isCanceled) {
+            return ImageColorsEngine::generatePalette(sourceImage, ImageColorsEngine::Quantizer(quantizer), isCanceled);
+        };
     }
 
-    positionColorMP(imageData.m_samples, imageData.m_clusters, numCore);
-
-    imageData.m_average = QColor(r / c, g / c, b / c, 255);
-
-    for (int iteration = 0; iteration < 5; ++iteration) {
-#pragma omp parallel for private(r, g, b, c)
-        for (int i = 0; i < imageData.m_clusters.size(); ++i) {
-            auto &stat = imageData.m_clusters[i];
-            r = 0;
-            g = 0;
-            b = 0;
-            c = 0;
-
-            for (auto color : std::as_const(stat.colors)) {
-                c++;
-                r += qRed(color);
-                g += qGreen(color);
-                b += qBlue(color);
-            }
-            r = r / c;
-            g = g / c;
-            b = b / c;
-            stat.centroid = qRgb(r, g, b);
-            stat.ratio = std::clamp(qreal(stat.colors.count()) / qreal(imageData.m_samples.count()), 0.0, 1.0);
-            stat.colors = QList<QRgb>({stat.centroid});
-        } // END omp parallel for
-
-        positionColorMP(imageData.m_samples, imageData.m_clusters, numCore);
-    }
+    m_request = ImageColorsCache::instance()->run(key, std::move(job), persistent);
+    m_futureImageData = new QFutureWatcher<ImageData>(this);
+    connect(m_futureImageData, &QFutureWatcher<ImageData>::finished, this, [this]() {
+        if (!m_futureImageData) {
+            return;
+        }
+        auto watcher = std::exchange(m_futureImageData, nullptr);
+        watcher->deleteLater();
+        m_request = {};
+        // Canceled jobs, e.g. when the application quits, have no result
+        if (watcher->isCanceled() || watcher->future().resultCount() == 0) {
+            return;
+        }
+        ImageData imageData = watcher->result();
+        postProcess(imageData);
 
-    std::sort(imageData.m_clusters.begin(), imageData.m_clusters.end(), [](const ImageData::colorStat &a, const ImageData::colorStat &b) {
-        return getClusterScore(a) > getClusterScore(b);
+        releaseCoarseRequest();
+        // Don't make the user interface flicker for details nobody will notice
+        if (std::exchange(m_coarse, false) && ImageColorsEngine::isSimilar(imageData, m_imageData)) {
+            return;
+        }
+        m_imageData = imageData;
+        Q_EMIT paletteChanged();
     });
+    m_futureImageData->setFuture(m_request.future);
 
-    // compress blocks that became too similar
-    auto sourceIt = imageData.m_clusters.end();
-    // Use index instead of iterator, because QList::erase may invalidate iterator.
-    std::vector<int> itemsToDelete;
-    while (sourceIt != imageData.m_clusters.begin()) {
-        sourceIt--;
-        for (auto destIt = imageData.m_clusters.begin(); destIt != imageData.m_clusters.end() && destIt != sourceIt; destIt++) {
-            if (squareDistance((*sourceIt).centroid, (*destIt).centroid) < s_minimumSquareDistance) {
-                const qreal ratio = (*sourceIt).ratio / (*destIt).ratio;
-                const int r = ratio * qreal(qRed((*sourceIt).centroid)) + (1 - ratio) * qreal(qRed((*destIt).centroid));
-                const int g = ratio * qreal(qGreen((*sourceIt).centroid)) + (1 - ratio) * qreal(qGreen((*destIt).centroid));
-                const int b = ratio * qreal(qBlue((*sourceIt).centroid)) + (1 - ratio) * qreal(qBlue((*destIt).centroid));
-                (*destIt).ratio += (*sourceIt).ratio;
-                (*destIt).centroid = qRgb(r, g, b);
-                itemsToDelete.push_back(std::distance(imageData.m_clusters.begin(), sourceIt));
-                break;
-            }
-        }
-    }
-    for (auto i : std::as_const(itemsToDelete)) {
-        imageData.m_clusters.removeAt(i);
+    if (m_progressive) {
+        runCoarseUpdate();
     }
+}
 
-    imageData.m_highlight = QColor();
-    imageData.m_dominant = QColor(imageData.m_clusters.first().centroid);
-    imageData.m_closestToBlack = Qt::white;
-    imageData.m_closestToWhite = Qt::black;
-
-    imageData.m_palette.clear();
-
-    bool first = true;
-
-#pragma omp parallel for ordered
-    for (int i = 0; i < imageData.m_clusters.size(); ++i) {
-        const auto &stat = imageData.m_clusters[i];
-        const QColor color(stat.centroid);
-
-        QColor contrast = QColor(255 - color.red(), 255 - color.green(), 255 - color.blue());
-        contrast.setHsl(contrast.hslHue(), //
-                        contrast.hslSaturation(), //
-                        128 + (128 - contrast.lightness()));
-        QColor tempContrast;
-        int minimumDistance = 4681800; // max distance: 4*3*2*3*255*255
-        for (const auto &stat : std::as_const(imageData.m_clusters)) {
-            const int distance = squareDistance(contrast.rgb(), stat.centroid);
+void ImageColors::runCoarseUpdate()
+{
+    static constexpr QSize coarseSize(32, 32);
+    // Not worth it when the complete palette is computed at about the same size
+    auto isSmall = [](const QSize &size) {
+        return size.isValid() && size.width() * size.height() <= coarseSize.width() * coarseSize.height();
+    };
 
-            if (distance < minimumDistance) {
-                tempContrast = QColor(stat.centroid);
-                minimumDistance = distance;
-            }
+    ImageColorsJob::Function job;
+    if (m_sourceLoader) {
+        if (isSmall(m_sourceSize)) {
+            return;
         }
-
-        if (imageData.m_clusters.size() <= 3) {
-            if (qGray(imageData.m_dominant.rgb()) < 120) {
-                contrast = QColor(230, 230, 230);
-            } else {
-                contrast = QColor(20, 20, 20);
+        job = [loader = m_sourceLoader,
+               path = m_sourcePath,
+               analysisSize = m_analysisSize,
+               quantizer = ImageColorsEngine::Quantizer(m_quantizer)](const std::function<bool()> &isCanceled) {
+            // A precomputed palette is as quick to get as a coarse one
+            if (!path.isEmpty()) {
+                if (auto imageData = ImageColorsCache::instance()->findInSidecar(path, analysisSize, quantizer)) {
+                    return *imageData;
+                }
             }
-            // TODO: replace m_clusters.size() > 3 with entropy calculation
-        } else if (squareDistance(contrast.rgb(), tempContrast.rgb()) < s_minimumSquareDistance * 1.5) {
-            contrast = tempContrast;
-        } else {
-            contrast = tempContrast;
-            contrast.setHsl(contrast.hslHue(),
-                            contrast.hslSaturation(),
-                            contrast.lightness() > 128 ? qMin(contrast.lightness() + 20, 255) : qMax(0, contrast.lightness() - 20));
+            return ImageColorsEngine::generatePalette(loader(coarseSize), quantizer, isCanceled);
+        };
+    } else {
+        if (isSmall(m_sourceImage.size())) {
+            return;
         }
-
-#pragma omp ordered
-        { // BEGIN omp ordered
-            if (first) {
-                imageData.m_dominantContrast = contrast;
-                imageData.m_dominant = color;
-            }
-            first = false;
-
-            if (!imageData.m_highlight.isValid() || ColorUtils::chroma(color) > ColorUtils::chroma(imageData.m_highlight)) {
-                imageData.m_highlight = color;
-            }
-
-            if (qGray(color.rgb()) > qGray(imageData.m_closestToWhite.rgb())) {
-                imageData.m_closestToWhite = color;
-            }
-            if (qGray(color.rgb()) < qGray(imageData.m_closestToBlack.rgb())) {
-                imageData.m_closestToBlack = color;
-            }
-            imageData.m_palette << PaletteSwatch(stat.ratio, color, contrast);
-        } // END omp ordered
+        job = [sourceImage = m_sourceImage, quantizer = m_quantizer](const std::function<bool()> &isCanceled) {
+            const QImage image = sourceImage.scaled(coarseSize, Qt::KeepAspectRatio, Qt::FastTransformation);
+            return ImageColorsEngine::generatePalette(image, ImageColorsEngine::Quantizer(quantizer), isCanceled);
+        };
     }
 
-    return imageData;
-}
+    // Not cached, and started after the complete palette so that it runs first
+    m_coarseRequest = ImageColorsCache::instance()->run(QString(), std::move(job));
+    m_futureCoarseImageData = new QFutureWatcher<ImageData>(this);
+    connect(m_futureCoarseImageData, &QFutureWatcher<ImageData>::finished, this, [this]() {
+        if (!m_futureCoarseImageData) {
+            return;
+        }
+        auto watcher = std::exchange(m_futureCoarseImageData, nullptr);
+        watcher->deleteLater();
+        m_coarseRequest = {};
+        if (watcher->isCanceled() || watcher->future().resultCount() == 0) {
+            return;
+        }
+        ImageData imageData = watcher->result();
 
-double ImageColors::getClusterScore(const ImageData::colorStat &stat)
-{
-    return stat.ratio * ColorUtils::chroma(QColor(stat.centroid));
+        postProcess(imageData);
+        m_imageData = imageData;
+        m_coarse = true;
+        Q_EMIT paletteChanged();
+    });
+    m_futureCoarseImageData->setFuture(m_coarseRequest.future);
 }
 
 void ImageColors::postProcess(ImageData &imageData) const
 {
-    constexpr short unsigned WCAG_NON_TEXT_CONTRAST_RATIO = 3;
-    constexpr qreal WCAG_TEXT_CONTRAST_RATIO = 4.5;
-
-    auto platformTheme = qmlAttachedPropertiesObject<Kirigami::Platform::PlatformTheme>(this, false);
+    auto platformTheme = static_cast<Kirigami::Platform::PlatformTheme *>(qmlAttachedPropertiesObject<Kirigami::Platform::PlatformTheme>(this, false));
     if (!platformTheme) {
         return;
     }
 
-    const QColor backgroundColor = static_cast<Kirigami::Platform::PlatformTheme *>(platformTheme)->backgroundColor();
-    const qreal backgroundLum = ColorUtils::luminance(backgroundColor);
-    qreal lowerLum, upperLum;
-    // 192 is from kcm_colors
-    if (qGray(backgroundColor.rgb()) < 192) {
-        // (lowerLum + 0.05) / (backgroundLum + 0.05) >= 3
-        lowerLum = WCAG_NON_TEXT_CONTRAST_RATIO * (backgroundLum + 0.05) - 0.05;
-        upperLum = 0.95;
-    } else {
-        // For light themes, still prefer lighter colors
-        // (lowerLum + 0.05) / (textLum + 0.05) >= 4.5
-        const QColor textColor =
-            static_cast<Kirigami::Platform::PlatformTheme *>(qmlAttachedPropertiesObject<Kirigami::Platform::PlatformTheme>(this, true))->textColor();
-        const qreal textLum = ColorUtils::luminance(textColor);
-        lowerLum = WCAG_TEXT_CONTRAST_RATIO * (textLum + 0.05) - 0.05;
-        upperLum = backgroundLum;
-    }
-
-    auto adjustSaturation = [](QColor &color) {
-        // Adjust saturation to make the color more vibrant
-        if (color.hsvSaturationF() < 0.5) {
-            const qreal h = color.hsvHueF();
-            const qreal v = color.valueF();
-            color.setHsvF(h, 0.5, v);
-        }
-    };
-    adjustSaturation(imageData.m_dominant);
-    adjustSaturation(imageData.m_highlight);
-    adjustSaturation(imageData.m_average);
-
-    auto adjustLightness = [lowerLum, upperLum](QColor &color) {
-        short unsigned colorOperationCount = 0;
-        const qreal h = color.hslHueF();
-        const qreal s = color.hslSaturationF();
-        const qreal l = color.lightnessF();
-        while (ColorUtils::luminance(color.rgb()) < lowerLum && colorOperationCount++ < 10) {
-            color.setHslF(h, s, std::min(1.0, l + colorOperationCount * 0.03));
-        }
-        while (ColorUtils::luminance(color.rgb()) > upperLum && colorOperationCount++ < 10) {
-            color.setHslF(h, s, std::max(0.0, l - colorOperationCount * 0.03));
-        }
-    };
-    adjustLightness(imageData.m_dominant);
-    adjustLightness(imageData.m_highlight);
-    adjustLightness(imageData.m_average);
+    ImageColorsEngine::postProcess(imageData, platformTheme->backgroundColor(), platformTheme->textColor());
 }
 
 QList<PaletteSwatch> ImageColors::palette() const
@@ -579,7 +574,7 @@ ColorUtils::Brightness ImageColors::paletteBrightness() const
     /* clang-format off */
     return_fallback(m_fallbackPaletteBrightness)
 
-    return qGray(m_imageData.m_dominant.rgb()) < 128 ? ColorUtils::Dark : ColorUtils::Light;
+    return m_imageData.paletteBrightness();
     /* clang-format on */
 }
 
@@ -615,18 +610,7 @@ QColor ImageColors::foreground() const
     /* clang-format off */
     return_fallback_finally(m_fallbackForeground, textColor)
 
-    if (paletteBrightness() == ColorUtils::Dark)
-    {
-        if (qGray(m_imageData.m_closestToWhite.rgb()) < 200) {
-            return QColor(230, 230, 230);
-        }
-        return m_imageData.m_closestToWhite;
-    } else {
-        if (qGray(m_imageData.m_closestToBlack.rgb()) > 80) {
-            return QColor(20, 20, 20);
-        }
-        return m_imageData.m_closestToBlack;
-    }
+    return m_imageData.foreground();
     /* clang-format on */
 }
 
@@ -635,17 +619,7 @@ QColor ImageColors::background() const
     /* clang-format off */
     return_fallback_finally(m_fallbackBackground, backgroundColor)
 
-    if (paletteBrightness() == ColorUtils::Dark) {
-        if (qGray(m_imageData.m_closestToBlack.rgb()) > 80) {
-            return QColor(20, 20, 20);
-        }
-        return m_imageData.m_closestToBlack;
-    } else {
-        if (qGray(m_imageData.m_closestToWhite.rgb()) < 200) {
-            return QColor(230, 230, 230);
-        }
-        return m_imageData.m_closestToWhite;
-    }
+    return m_imageData.background();
     /* clang-format on */
 }
 
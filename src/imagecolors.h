@@ -8,66 +8,35 @@
 #pragma once
 
 #include <QColor>
+#include <QElapsedTimer>
 #include <QFuture>
+#include <QIcon>
 #include <QImage>
 #include <QObject>
 #include <QPointer>
 #include <QQuickItem>
 #include <QQuickItemGrabResult>
 #include <QQuickWindow>
+#include <QTimer>
 
-#include <platform/colorutils.h>
+#include <functional>
 
-struct PaletteSwatch {
+#include "imagecolorsengine.h"
+
+// The engine is also used outside of QML, see the kirigami-imagecolors tool
+struct PaletteSwatchForeign {
     Q_GADGET
+    QML_FOREIGN(PaletteSwatch)
     QML_VALUE_TYPE(imageColorsPaletteSwatch)
-
-    Q_PROPERTY(qreal ratio READ ratio FINAL)
-    Q_PROPERTY(QColor color READ color FINAL)
-    Q_PROPERTY(QColor contrastColor READ contrastColor FINAL)
-
-public:
-    explicit PaletteSwatch();
-    explicit PaletteSwatch(qreal ratio, const QColor &color, const QColor &contrastColor);
-
-    qreal ratio() const;
-    const QColor &color() const;
-    const QColor &contrastColor() const;
-
-    bool operator==(const PaletteSwatch &other) const;
-
-private:
-    qreal m_ratio;
-    QColor m_color;
-    QColor m_contrastColor;
 };
 
-struct ImageData {
-    struct colorStat {
-        QList<QRgb> colors;
-        QRgb centroid = 0;
-        qreal ratio = 0;
-    };
-
-    struct colorSet {
-        QColor average;
-        QColor text;
-        QColor background;
-        QColor highlight;
-    };
-
-    QList<QRgb> m_samples;
-    QList<colorStat> m_clusters;
-    QList<PaletteSwatch> m_palette;
-
-    bool m_darkPalette = true;
-    QColor m_dominant = Qt::transparent;
-    QColor m_dominantContrast;
-    QColor m_average;
-    QColor m_highlight;
-
-    QColor m_closestToBlack;
-    QColor m_closestToWhite;
+/**
+ * A palette requested from ImageColorsCache, see ImageColorsCache::run().
+ */
+struct ImageColorsRequest {
+    QFuture<ImageData> future;
+    QString key;
+    quint64 id = 0;
 };
 
 /**
@@ -225,7 +194,85 @@ class ImageColors : public QObject
      */
     Q_PROPERTY(QColor fallbackBackground MEMBER m_fallbackBackground NOTIFY fallbackBackgroundChanged FINAL)
 
+    /**
+     * The algorithm used to group the colors of the source image into the palette.
+     *
+     * * ImageColors.Clustering: every sampled pixel is clustered individually. This is the default.
+     * * ImageColors.Histogram: sampled pixels are counted in a fixed 5-bit-per-channel
+     *   color histogram which is then clustered with k-means. Time is linear in the
+     *   number of pixels and memory use does not depend on the size of the image,
+     *   which makes it better suited to large images.
+     *
+     * \since 6.8
+     */
+    Q_PROPERTY(Quantizer quantizer READ quantizer WRITE setQuantizer NOTIFY quantizerChanged FINAL)
+
+    /**
+     * Whether palettes of file and URL sources should be kept in a cache on disk,
+     * so they are available immediately the next time the application starts.
+     *
+     * Entries are identified by the path, size and modification time of the file.
+     * The cache is stored in the cache directory of the application.
+     *
+     * default: `false`
+     *
+     * \since 6.8
+     */
+    Q_PROPERTY(bool persistentCache READ persistentCache WRITE setPersistentCache NOTIFY persistentCacheChanged FINAL)
+
+    /**
+     * The resolution at which the source is analyzed.
+     *
+     * Files and URLs are decoded at no more than this size, keeping their aspect
+     * ratio, so the time and memory needed to decode them do not depend on their
+     * resolution. Formats that support it, such as JPEG, are scaled down while
+     * decoding. Icons are rendered and items are grabbed at this size.
+     *
+     * Set it to an invalid size to analyze files at their full resolution.
+     *
+     * default: `Qt.size(128, 128)`
+     *
+     * \since 6.8
+     */
+    Q_PROPERTY(QSize analysisSize READ analysisSize WRITE setAnalysisSize NOTIFY analysisSizeChanged FINAL)
+
+    /**
+     * The minimum time in milliseconds between two grabs of an Item source.
+     *
+     * Updates of an Item source are always coalesced to at most one grab per
+     * frame, and the palette is only computed again when the grabbed contents
+     * changed. Set this to limit the rate further for items which change often,
+     * e.g. animated ones or video.
+     *
+     * default: `0`
+     *
+     * \since 6.8
+     */
+    Q_PROPERTY(int minimumUpdateInterval READ minimumUpdateInterval WRITE setMinimumUpdateInterval NOTIFY minimumUpdateIntervalChanged FINAL)
+
+    /**
+     * Whether a coarse palette should be provided while the palette is computed.
+     *
+     * When set, a palette extracted from a 32x32 version of the source is
+     * available almost immediately, and the palette at analysisSize replaces
+     * it once it is ready. paletteChanged() is only emitted a second time if
+     * the two differ noticeably, otherwise the coarse palette stays.
+     *
+     * Palettes found in the cache are always complete.
+     *
+     * default: `false`
+     *
+     * \since 6.8
+     */
+    Q_PROPERTY(bool progressive READ progressive WRITE setProgressive NOTIFY progressiveChanged FINAL)
+
 public:
+    enum Quantizer {
+        Clustering = ImageColorsEngine::Clustering,
+        Histogram = ImageColorsEngine::Histogram,
+    };
+    Q_ENUM(Quantizer)
+
     explicit ImageColors(QObject *parent = nullptr);
     ~ImageColors() override;
 
@@ -238,6 +285,21 @@ public:
     void setSourceItem(QQuickItem *source);
     QQuickItem *sourceItem() const;
 
+    Quantizer quantizer() const;
+    void setQuantizer(Quantizer quantizer);
+
+    bool persistentCache() const;
+    void setPersistentCache(bool persistent);
+
+    QSize analysisSize() const;
+    void setAnalysisSize(const QSize &size);
+
+    int minimumUpdateInterval() const;
+    void setMinimumUpdateInterval(int interval);
+
+    bool progressive() const;
+    void setProgressive(bool progressive);
+
     Q_INVOKABLE void update();
 
     QList<PaletteSwatch> palette() const;
@@ -262,26 +324,65 @@ Q_SIGNALS:
     void fallbackHighlightChanged();
     void fallbackForegroundChanged();
     void fallbackBackgroundChanged();
+    void quantizerChanged();
+    void persistentCacheChanged();
+    void analysisSizeChanged();
+    void minimumUpdateIntervalChanged();
+    void progressiveChanged();
 
 private:
-    static inline void positionColor(QRgb rgb, QList<ImageData::colorStat> &clusters);
-    static void positionColorMP(const decltype(ImageData::m_samples) &samples, decltype(ImageData::m_clusters) &clusters, int numCore = 0);
-    static ImageData generatePalette(const QImage &sourceImage);
+    void setSourceImage(const QImage &image, const QString &key);
+    void setSourceIcon(const QIcon &icon, const QString &key);
+    void setSourceLoader(std::function<QImage(const QSize &size)> &&loader, const QSize &size, const QString &key, const QString &path = QString());
+    void clearSourceItem();
+    void grab();
+    void releaseRequest();
+    void releaseCoarseRequest();
+    void runUpdate();
+    void runCoarseUpdate();
+    QString cacheKey() const;
+    static QString cacheKey(const QString &sourceKey, Quantizer quantizer);
+    QSize iconSize() const;
+    static QString fileKey(const QString &path, const QSize &analysisSize);
 
-    static double getClusterScore(const ImageData::colorStat &stat);
     void postProcess(ImageData &imageData) const;
 
-    // Arbitrary number that seems to work well
-    static const int s_minimumSquareDistance = 32000;
     QPointer<QQuickWindow> m_window;
     QVariant m_source;
     QPointer<QQuickItem> m_sourceItem;
     QSharedPointer<QQuickItemGrabResult> m_grabResult;
+    // Coalesces updates of an item source, see minimumUpdateInterval
+    QTimer m_grabTimer;
+    QElapsedTimer m_lastGrabTime;
+    // Another grab was requested while one was in flight
+    bool m_grabQueued = false;
+    // The last grabbed contents, the palette is only computed again when they change
+    QImage m_grabbedImage;
     QImage m_sourceImage;
-    QFutureWatcher<QImage> *m_futureSourceImageData = nullptr;
+    // Rendered into m_sourceImage on the GUI thread when the palette is not cached
+    QIcon m_sourceIcon;
+    // Produces the source image at the requested size on a worker thread, replaces m_sourceImage when set
+    std::function<QImage(const QSize &size)> m_sourceLoader;
+    // The size passed to the loader for the complete palette
+    QSize m_sourceSize;
+    // Identifies the source in ImageColorsCache, empty if it should not be cached
+    QString m_sourceKey;
+    // The file the loader reads, to look for a precomputed palette
+    QString m_sourcePath;
 
     QFutureWatcher<ImageData> *m_futureImageData = nullptr;
+    ImageColorsRequest m_request;
+    // The coarse palette of progressive mode, see runCoarseUpdate()
+    QFutureWatcher<ImageData> *m_futureCoarseImageData = nullptr;
+    ImageColorsRequest m_coarseRequest;
     ImageData m_imageData;
+    // m_imageData is a coarse palette, the complete one is still being computed
+    bool m_coarse = false;
+    Quantizer m_quantizer = Clustering;
+    bool m_persistentCache = false;
+    QSize m_analysisSize = QSize(128, 128);
+    int m_minimumUpdateInterval = 0;
+    bool m_progressive = false;
 
     QList<PaletteSwatch> m_fallbackPalette;
     ColorUtils::Brightness m_fallbackPaletteBrightness;
@@ -291,4 +392,6 @@ private:
     QColor m_fallbackHighlight;
     QColor m_fallbackForeground;
     QColor m_fallbackBackground;
+
+    friend class ImageColorsModel;
 };
@@ -0,0 +1,190 @@
+/*
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include "imagecolorscache.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QPromise>
+#include <QStandardPaths>
+
+// Entries are small, a palette is a couple of dozen colors at most
+static constexpr int s_maximumEntries = 512;
+// The persistent cache starts over once it grows past this
+static constexpr qint64 s_maximumDiskCacheSize = 16 * 1024 * 1024;
+// Each open sidecar holds a file descriptor and a mapping of the file
+static constexpr int s_maximumSidecars = 32;
+
+ImageColorsCache *ImageColorsCache::instance()
+{
+    static ImageColorsCache cache;
+    return &cache;
+}
+
+ImageColorsCache::ImageColorsCache()
+    : m_cache(s_maximumEntries)
+    , m_sidecars(s_maximumSidecars)
+{
+}
+
+ImageColorsDiskCache *ImageColorsCache::diskCache()
+{
+    if (!m_diskCache) {
+        const QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+        m_diskCache = std::make_unique<ImageColorsDiskCache>(directory + QStringLiteral("/kirigami-imagecolors.cache"),
+                                                             ImageColorsDiskCache::ReadWrite,
+                                                             s_maximumDiskCacheSize);
+    }
+    return m_diskCache.get();
+}
+
+std::optional<ImageData> ImageColorsCache::findOnDisk(const QString &key)
+{
+    QMutexLocker locker(&m_diskMutex);
+    return diskCache()->find(key);
+}
+
+void ImageColorsCache::insertOnDisk(const QString &key, const ImageData &imageData)
+{
+    QMutexLocker locker(&m_diskMutex);
+    diskCache()->insert(key, imageData);
+}
+
+std::optional<ImageData> ImageColorsCache::find(const QString &key, bool persistent)
+{
+    QMutexLocker locker(&m_mutex);
+    return findLocked(key, persistent);
+}
+
+std::optional<ImageData> ImageColorsCache::findLocked(const QString &key, bool persistent)
+{
+    Entry *entry = m_cache.object(key);
+    if (!entry) {
+        return std::nullopt;
+    }
+
+    if (persistent && !entry->persistent) {
+        // It may have been computed for an instance which did not ask for
+        // persistence. The caller is usually the GUI thread, write it from the pool.
+        entry->persistent = true;
+        ImageColorsJob::threadPool()->start([this, key, imageData = entry->imageData]() {
+            insertOnDisk(key, imageData);
+        });
+    }
+    return entry->imageData;
+}
+
+std::optional<ImageData> ImageColorsCache::findInSidecar(const QString &path, const QSize &analysisSize, ImageColorsEngine::Quantizer quantizer)
+{
+    const QString directory = QFileInfo(path).absolutePath();
+    const QString key = ImageColorsDiskCache::sidecarKey(path, analysisSize, quantizer);
+    // Adding, replacing or removing the sidecar changes the modification time of the directory
+    const QDateTime directoryModified = QFileInfo(directory).lastModified();
+
+    QMutexLocker locker(&m_diskMutex);
+
+    Sidecar *sidecar = m_sidecars.object(directory);
+    if (!sidecar || sidecar->directoryModified != directoryModified) {
+        sidecar = new Sidecar{nullptr, directoryModified};
+        const QString fileName = ImageColorsDiskCache::sidecarFileName(directory);
+        if (QFileInfo::exists(fileName)) {
+            sidecar->cache = std::make_unique<ImageColorsDiskCache>(fileName, ImageColorsDiskCache::ReadOnly);
+        }
+        m_sidecars.insert(directory, sidecar);
+    }
+
+    if (!sidecar->cache) {
+        return std::nullopt;
+    }
+    return sidecar->cache->find(key);
+}
+
+void ImageColorsCache::insert(const QString &key, const ImageData &imageData, bool persistent)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_cache.insert(key, new Entry{imageData, persistent});
+    }
+    if (persistent) {
+        insertOnDisk(key, imageData);
+    }
+}
+
+ImageColorsRequest ImageColorsCache::run(const QString &key, ImageColorsJob::Function &&function, bool persistent)
+{
+    if (key.isEmpty()) {
+        return {ImageColorsJob::start(std::move(function)), key, 0};
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    // It may have been inserted since the caller last looked
+    if (auto imageData = findLocked(key, persistent)) {
+        QPromise<ImageData> promise;
+        promise.start();
+        promise.addResult(*imageData);
+        promise.finish();
+        return {promise.future(), key, 0};
+    }
+
+    if (auto it = m_running.find(key); it != m_running.end()) {
+        ++it->waiters;
+        it->persistent = it->persistent || persistent;
+        return {it->future, key, it->id};
+    }
+
+    const quint64 id = ++m_lastId;
+    // The job can only take the lock once it has been registered below
+    QFuture<ImageData> future = ImageColorsJob::start([this, key, id, persistent, function = std::move(function)](const std::function<bool()> &isCanceled) {
+        // The persistent cache is only accessed from the pool, as it may wait
+        // on the disk or on other processes
+        const std::optional<ImageData> stored = persistent ? findOnDisk(key) : std::nullopt;
+        ImageData imageData = stored ? *stored : function(isCanceled);
+
+        bool store = false;
+        {
+            QMutexLocker locker(&m_mutex);
+            // Released jobs are removed by release(), a newer job may have taken their place
+            auto it = m_running.find(key);
+            if (it == m_running.end() || it->id != id) {
+                return imageData;
+            }
+            if (!isCanceled()) {
+                m_cache.insert(key, new Entry{imageData, it->persistent});
+                store = it->persistent && !stored;
+            }
+            m_running.erase(it);
+        }
+
+        if (store) {
+            insertOnDisk(key, imageData);
+        }
+        return imageData;
+    });
+    m_running.insert(key, {future, id, 1, persistent});
+    return {future, key, id};
+}
+
+void ImageColorsCache::release(const ImageColorsRequest &request)
+{
+    if (request.id == 0) {
+        // Not shared with anybody
+        QFuture<ImageData> future = request.future;
+        future.cancel();
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    auto it = m_running.find(request.key);
+    if (it == m_running.end() || it->id != request.id) {
+        return; // Already finished
+    }
+    if (--it->waiters == 0) {
+        it->future.cancel();
+        m_running.erase(it);
+    }
+}
@@ -0,0 +1,119 @@
+/*
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <QCache>
+#include <QDateTime>
+#include <QFuture>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+#include <functional>
+#include <memory>
+#include <optional>
+
+#include "imagecolors.h"
+#include "imagecolorsdiskcache.h"
+#include "imagecolorsjob.h"
+
+/**
+ * A process-wide cache of generated palettes, shared by all ImageColors instances.
+ *
+ * Palettes are stored as returned by ImageColors::generatePalette(), i.e. before
+ * they are adjusted to the theme of a particular instance. Entries are identified
+ * by a key describing the source, see ImageColors::cacheKey().
+ *
+ * Requests for a key which is already being computed join the computation in
+ * flight instead of starting another one. A computation is only canceled once
+ * every request waiting for it has been released.
+ *
+ * Palettes requested as persistent are additionally kept in an ImageColorsDiskCache
+ * in the cache directory of the application, so they survive restarts. It is only
+ * read and written from the palette jobs, as the disk or other processes using it
+ * may keep it busy for a while.
+ *
+ * This class is thread-safe.
+ */
+class ImageColorsCache
+{
+public:
+    static ImageColorsCache *instance();
+
+    /**
+     * Returns the palette kept in memory for @p key, if any. Palettes only
+     * kept in the persistent cache are found by run().
+     */
+    std::optional<ImageData> find(const QString &key, bool persistent = false);
+
+    /**
+     * Returns the palette of the image file @p path precomputed in the sidecar
+     * of its directory, if there is one, see ImageColorsDiskCache::sidecarFileName().
+     */
+    std::optional<ImageData> findInSidecar(const QString &path, const QSize &analysisSize, ImageColorsEngine::Quantizer quantizer);
+
+    /**
+     * Stores @p imageData as the palette of @p key, for palettes computed outside
+     * of run(). When @p persistent, this writes to the persistent cache, so it
+     * should not be called from the GUI thread.
+     */
+    void insert(const QString &key, const ImageData &imageData, bool persistent = false);
+
+    /**
+     * Returns a request for the palette of @p key, running @p function as an
+     * ImageColorsJob to compute it if it is neither cached nor already being
+     * computed. The result is cached once the function returns, unless it was
+     * canceled. An empty @p key always starts a new job and caches nothing.
+     *
+     * The future of the request may be shared with other callers, so it must
+     * not be canceled directly, use release() instead.
+     */
+    ImageColorsRequest run(const QString &key, ImageColorsJob::Function &&function, bool persistent = false);
+
+    /**
+     * Signals that the caller is not interested in the result of @p request
+     * anymore, canceling the job if nobody else is waiting for it.
+     */
+    void release(const ImageColorsRequest &request);
+
+private:
+    ImageColorsCache();
+
+    std::optional<ImageData> findLocked(const QString &key, bool persistent);
+    std::optional<ImageData> findOnDisk(const QString &key);
+    void insertOnDisk(const QString &key, const ImageData &imageData);
+    ImageColorsDiskCache *diskCache();
+
+    // Guards the palettes in memory and the running jobs
+    QMutex m_mutex;
+    struct Entry {
+        ImageData imageData;
+        // Whether it was written to the persistent cache
+        bool persistent = false;
+    };
+    QCache<QString, Entry> m_cache;
+
+    struct Running {
+        QFuture<ImageData> future;
+        quint64 id = 0;
+        int waiters = 0;
+        bool persistent = false;
+    };
+    QHash<QString, Running> m_running;
+    quint64 m_lastId = 0;
+
+    // Guards the persistent cache and the sidecars, never taken along with m_mutex
+    QMutex m_diskMutex;
+    std::unique_ptr<ImageColorsDiskCache> m_diskCache;
+    struct Sidecar {
+        // Null for directories without a sidecar
+        std::unique_ptr<ImageColorsDiskCache> cache;
+        QDateTime directoryModified;
+    };
+    // By directory, only the most recently used ones are kept open
+    QCache<QString, Sidecar> m_sidecars;
+};
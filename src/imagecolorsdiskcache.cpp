@@ -0,0 +1,332 @@
+/*
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include "imagecolorsdiskcache.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QScopeGuard>
+#include <QtEndian>
+
+#include "loggingcategory.h"
+
+// "KPAL"
+static constexpr quint32 s_diskCacheMagic = 0x4b50414c;
+// Bump whenever the record format or the palette generation changes
+static constexpr quint32 s_diskCacheVersion = 1;
+static constexpr qint64 s_diskCacheHeaderSize = 2 * sizeof(quint32);
+// In milliseconds
+static constexpr int s_lockTimeout = 100;
+
+static constexpr QDataStream::Version s_dataStreamVersion = QDataStream::Qt_6_5;
+
+ImageColorsDiskCache::ImageColorsDiskCache(const QString &fileName, OpenMode mode, qint64 maximumSize)
+    : m_file(fileName)
+    , m_lockFile(fileName + QStringLiteral(".lock"))
+    , m_mode(mode)
+    , m_maximumSize(maximumSize)
+{
+}
+
+ImageColorsDiskCache::~ImageColorsDiskCache()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+    }
+}
+
+bool ImageColorsDiskCache::lock()
+{
+    // The cache is only an optimization, don't block for long on other processes
+    if (!m_lockFile.tryLock(s_lockTimeout)) {
+        qCWarning(KirigamiLog) << "Could not lock palette cache" << m_file.fileName() << m_lockFile.error();
+        return false;
+    }
+    return true;
+}
+
+bool ImageColorsDiskCache::open()
+{
+    if (m_opened) {
+        return m_valid;
+    }
+    m_opened = true;
+
+    if (m_mode == ReadOnly) {
+        return load();
+    }
+
+    QDir().mkpath(QFileInfo(m_file.fileName()).absolutePath());
+    if (!lock()) {
+        return false;
+    }
+    const auto unlock = qScopeGuard([this]() {
+        m_lockFile.unlock();
+    });
+    return load();
+}
+
+bool ImageColorsDiskCache::load()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+    m_mapSize = 0;
+    m_index.clear();
+    m_file.close();
+
+    if (m_mode == ReadOnly) {
+        if (!m_file.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+        m_valid = m_file.size() >= s_diskCacheHeaderSize;
+        if (!m_valid) {
+            return false;
+        }
+    } else {
+        if (!m_file.open(QIODevice::ReadWrite)) {
+            qCWarning(KirigamiLog) << "Could not open palette cache" << m_file.fileName() << m_file.errorString();
+            m_valid = false;
+            return false;
+        }
+        m_valid = true;
+
+        if (m_file.size() < s_diskCacheHeaderSize || (m_maximumSize > 0 && m_file.size() > m_maximumSize)) {
+            reset();
+            return m_valid;
+        }
+    }
+
+    m_mapSize = m_file.size();
+    m_map = m_file.map(0, m_mapSize);
+    if (!m_map) {
+        reset();
+        return m_valid;
+    }
+
+    {
+        QDataStream header(QByteArray::fromRawData(reinterpret_cast<const char *>(m_map), s_diskCacheHeaderSize));
+        quint32 magic = 0;
+        quint32 version = 0;
+        header >> magic >> version;
+        if (magic != s_diskCacheMagic || version != s_diskCacheVersion) {
+            reset();
+            return m_valid;
+        }
+    }
+
+    // Index the keys, palettes are decoded on demand
+    qint64 offset = s_diskCacheHeaderSize;
+    while (offset + qint64(sizeof(quint32)) <= m_mapSize) {
+        const quint32 size = qFromBigEndian<quint32>(m_map + offset);
+        const qint64 recordOffset = offset + sizeof(quint32);
+        if (recordOffset + size > m_mapSize) {
+            break;
+        }
+
+        QDataStream stream(QByteArray::fromRawData(reinterpret_cast<const char *>(m_map + recordOffset), size));
+        stream.setVersion(s_dataStreamVersion);
+        QString key;
+        stream >> key;
+        if (stream.status() != QDataStream::Ok) {
+            break;
+        }
+        if (!m_index.contains(key)) {
+            m_index.insert(key, {recordOffset, size});
+        }
+        offset = recordOffset + size;
+    }
+
+    if (offset != m_mapSize) {
+        // Drop whatever an interrupted write left behind
+        if (m_mode == ReadWrite) {
+            qCDebug(KirigamiLog) << "Truncating damaged palette cache" << m_file.fileName() << "at" << offset;
+            reset(offset);
+        } else {
+            m_mapSize = offset;
+        }
+    }
+
+    return m_valid;
+}
+
+void ImageColorsDiskCache::reset(qint64 keep)
+{
+    QByteArray contents;
+    if (keep > s_diskCacheHeaderSize) {
+        contents = QByteArray(reinterpret_cast<const char *>(m_map), keep);
+    } else {
+        QDataStream header(&contents, QIODevice::WriteOnly);
+        header << s_diskCacheMagic << s_diskCacheVersion;
+        m_index.clear();
+    }
+
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+    m_mapSize = 0;
+    m_valid = false;
+
+    if (m_mode == ReadOnly) {
+        m_index.clear();
+        return;
+    }
+
+    // Other processes may have mapped the file, accessing it past its end after
+    // it shrank would crash them. Replace it with a new file instead, they keep
+    // using the old one until they open the cache again.
+    QSaveFile file(m_file.fileName());
+    if (!file.open(QIODevice::WriteOnly) || file.write(contents) != contents.size() || !file.commit()) {
+        qCWarning(KirigamiLog) << "Could not reset palette cache" << m_file.fileName() << file.errorString();
+        m_index.clear();
+        return;
+    }
+
+    m_file.close();
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        m_index.clear();
+        return;
+    }
+    m_valid = true;
+
+    // Records are read from the file when it can't be mapped
+    m_mapSize = m_file.size();
+    m_map = m_file.map(0, m_mapSize);
+    if (!m_map) {
+        m_mapSize = 0;
+    }
+}
+
+std::optional<ImageData> ImageColorsDiskCache::find(const QString &key)
+{
+    if (!open()) {
+        return std::nullopt;
+    }
+
+    const auto it = m_index.constFind(key);
+    if (it == m_index.cend()) {
+        return std::nullopt;
+    }
+    return read(it->offset, it->size);
+}
+
+std::optional<ImageData> ImageColorsDiskCache::read(qint64 offset, qint64 size)
+{
+    QByteArray bytes;
+    if (offset + size <= m_mapSize) {
+        bytes = QByteArray::fromRawData(reinterpret_cast<const char *>(m_map + offset), size);
+    } else {
+        // Appended after the file was mapped
+        if (!m_file.seek(offset)) {
+            return std::nullopt;
+        }
+        bytes = m_file.read(size);
+    }
+
+    QDataStream stream(bytes);
+    stream.setVersion(s_dataStreamVersion);
+
+    QString key;
+    quint32 paletteSize = 0;
+    ImageData imageData;
+    stream >> key >> paletteSize;
+    for (quint32 i = 0; i < paletteSize && stream.status() == QDataStream::Ok; ++i) {
+        qreal ratio = 0;
+        QColor color;
+        QColor contrastColor;
+        stream >> ratio >> color >> contrastColor;
+        imageData.m_palette << PaletteSwatch(ratio, color, contrastColor);
+    }
+    stream >> imageData.m_darkPalette //
+        >> imageData.m_dominant //
+        >> imageData.m_dominantContrast //
+        >> imageData.m_average //
+        >> imageData.m_highlight //
+        >> imageData.m_closestToBlack //
+        >> imageData.m_closestToWhite;
+
+    if (stream.status() != QDataStream::Ok) {
+        return std::nullopt;
+    }
+    return imageData;
+}
+
+void ImageColorsDiskCache::insert(const QString &key, const ImageData &imageData)
+{
+    if (m_mode == ReadOnly || !open() || m_index.contains(key)) {
+        return;
+    }
+
+    QByteArray bytes;
+    {
+        QDataStream stream(&bytes, QIODevice::WriteOnly);
+        stream.setVersion(s_dataStreamVersion);
+        stream << key << quint32(imageData.m_palette.size());
+        for (const auto &swatch : imageData.m_palette) {
+            stream << swatch.ratio() << swatch.color() << swatch.contrastColor();
+        }
+        stream << imageData.m_darkPalette //
+               << imageData.m_dominant //
+               << imageData.m_dominantContrast //
+               << imageData.m_average //
+               << imageData.m_highlight //
+               << imageData.m_closestToBlack //
+               << imageData.m_closestToWhite;
+    }
+
+    // Other processes append to the same file
+    if (!lock()) {
+        return;
+    }
+    const auto unlock = qScopeGuard([this]() {
+        m_lockFile.unlock();
+    });
+
+    // All writes happen under the lock, so the file at the path only differs
+    // in size from the one opened if another process replaced it in reset()
+    if (QFileInfo(m_file.fileName()).size() != m_file.size()) {
+        if (!load() || m_index.contains(key)) {
+            return;
+        }
+    }
+
+    const qint64 offset = m_file.size();
+    if (!m_file.seek(offset)) {
+        return;
+    }
+    const quint32 size = qToBigEndian<quint32>(bytes.size());
+    if (m_file.write(reinterpret_cast<const char *>(&size), sizeof(size)) != sizeof(size) || m_file.write(bytes) != bytes.size()) {
+        // The incomplete record is dropped the next time the cache is opened
+        qCWarning(KirigamiLog) << "Could not write to palette cache" << m_file.fileName() << m_file.errorString();
+        m_file.flush();
+        return;
+    }
+    m_file.flush();
+
+    m_index.insert(key, {offset + qint64(sizeof(quint32)), bytes.size()});
+}
+
+QString ImageColorsDiskCache::sidecarFileName(const QString &directory)
+{
+    return directory + QStringLiteral("/.kirigami-imagecolors.cache");
+}
+
+QString ImageColorsDiskCache::sidecarKey(const QString &path, const QSize &analysisSize, ImageColorsEngine::Quantizer quantizer)
+{
+    // Whole seconds, as file systems and copies don't all keep finer modification times
+    const QFileInfo info(path);
+    return QStringLiteral("%1:%2:%3:%4x%5:%6")
+        .arg(info.fileName(),
+             QString::number(info.size()),
+             QString::number(info.lastModified().toSecsSinceEpoch()),
+             QString::number(analysisSize.width()),
+             QString::number(analysisSize.height()),
+             QString::number(quantizer));
+}
@@ -0,0 +1,99 @@
+/*
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <QFile>
+#include <QHash>
+#include <QLockFile>
+#include <QSize>
+#include <QString>
+
+#include <optional>
+
+#include "imagecolorsengine.h"
+
+/**
+ * A persistent store of generated palettes.
+ *
+ * The file starts with a header holding a magic number and the format version,
+ * followed by records which are only ever appended. Each record is a 32-bit
+ * size followed by the key and the palette, serialized with QDataStream.
+ *
+ * Opening the store maps the file and indexes the keys, palettes are only
+ * decoded when they are looked up. A store written by a different version
+ * or truncated by a crash is reset or cut back to the last complete record.
+ * A store opened read-only is never modified, invalid ones are just ignored.
+ *
+ * Several processes can use the same store. Opening and appending happen under
+ * a QLockFile, and the file is never shrunk in place since other processes may
+ * have mapped it. It is replaced by a new file instead.
+ *
+ * The same format is used for sidecar files holding the palettes precomputed
+ * for the images of a directory, see the kirigami-imagecolors tool.
+ *
+ * This class is not thread-safe, ImageColorsCache serializes access to it.
+ */
+class ImageColorsDiskCache
+{
+public:
+    enum OpenMode {
+        ReadWrite,
+        ReadOnly,
+    };
+
+    /**
+     * Records are never removed, so a store opened with a @p maximumSize
+     * starts over once its file grows past it. A @p maximumSize of 0 means
+     * the file may grow without bounds, as for sidecars, which only hold the
+     * palettes of the images of their directory.
+     */
+    explicit ImageColorsDiskCache(const QString &fileName, OpenMode mode = ReadWrite, qint64 maximumSize = 0);
+    ~ImageColorsDiskCache();
+
+    std::optional<ImageData> find(const QString &key);
+    void insert(const QString &key, const ImageData &imageData);
+
+    /**
+     * Returns the name of the sidecar file for the images of @p directory.
+     */
+    static QString sidecarFileName(const QString &directory);
+
+    /**
+     * Returns the key of the palette of the image file @p path in its sidecar.
+     *
+     * The key is relative to the directory, so sidecars stay valid when a
+     * directory is moved, or copied to another machine along with its sidecar
+     * while keeping the modification times. It includes the size and the
+     * modification time of the file, so images edited since the sidecar was
+     * written are not given the palette of their previous contents.
+     */
+    static QString sidecarKey(const QString &path, const QSize &analysisSize, ImageColorsEngine::Quantizer quantizer);
+
+private:
+    bool lock();
+    bool open();
+    bool load();
+    // Replaces the file with its first @p keep bytes, or just a header
+    void reset(qint64 keep = 0);
+    std::optional<ImageData> read(qint64 offset, qint64 size);
+
+    QFile m_file;
+    QLockFile m_lockFile;
+    OpenMode m_mode;
+    qint64 m_maximumSize;
+    bool m_opened = false;
+    bool m_valid = false;
+
+    uchar *m_map = nullptr;
+    qint64 m_mapSize = 0;
+
+    struct Record {
+        qint64 offset;
+        qint64 size;
+    };
+    QHash<QString, Record> m_index;
+};
@@ -0,0 +1,894 @@
+/*
+ *  SPDX-FileCopyrightText: 2020 Marco Martin <mart@kde.org>
+ *  SPDX-FileCopyrightText: 2024 ivan tkachenko <me@ratijas.tk>
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "imagecolorsengine.h"
+
+#include <QImageReader>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <private/qsimd_p.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#include "config-OpenMP.h"
+#if HAVE_OpenMP
+#include <omp.h>
+#endif
+
+static std::atomic<int> s_concurrentJobs = 1;
+
+PaletteSwatch::PaletteSwatch()
+{
+}
+
+PaletteSwatch::PaletteSwatch(qreal ratio, const QColor &color, const QColor &contrastColor)
+    : m_ratio(ratio)
+    , m_color(color)
+    , m_contrastColor(contrastColor)
+{
+}
+
+qreal PaletteSwatch::ratio() const
+{
+    return m_ratio;
+}
+
+const QColor &PaletteSwatch::color() const
+{
+    return m_color;
+}
+
+const QColor &PaletteSwatch::contrastColor() const
+{
+    return m_contrastColor;
+}
+
+bool PaletteSwatch::operator==(const PaletteSwatch &other) const
+{
+    return m_ratio == other.m_ratio //
+        && m_color == other.m_color //
+        && m_contrastColor == other.m_contrastColor;
+}
+
+ColorUtils::Brightness ImageData::paletteBrightness() const
+{
+    return qGray(m_dominant.rgb()) < 128 ? ColorUtils::Dark : ColorUtils::Light;
+}
+
+QColor ImageData::foreground() const
+{
+    if (paletteBrightness() == ColorUtils::Dark) {
+        if (qGray(m_closestToWhite.rgb()) < 200) {
+            return QColor(230, 230, 230);
+        }
+        return m_closestToWhite;
+    } else {
+        if (qGray(m_closestToBlack.rgb()) > 80) {
+            return QColor(20, 20, 20);
+        }
+        return m_closestToBlack;
+    }
+}
+
+QColor ImageData::background() const
+{
+    if (paletteBrightness() == ColorUtils::Dark) {
+        if (qGray(m_closestToBlack.rgb()) > 80) {
+            return QColor(20, 20, 20);
+        }
+        return m_closestToBlack;
+    } else {
+        if (qGray(m_closestToWhite.rgb()) < 200) {
+            return QColor(230, 230, 230);
+        }
+        return m_closestToWhite;
+    }
+}
+
+void ImageColorsEngine::setConcurrentJobs(int jobs)
+{
+    s_concurrentJobs = std::max(1, jobs);
+}
+
+QImage ImageColorsEngine::loadImage(const QString &path, const QSize &analysisSize)
+{
+    QImageReader reader(path);
+    // Only the colors matter, favor decoding speed over quality
+    reader.setQuality(0);
+
+    const QSize size = reader.size();
+    if (!analysisSize.isValid()) {
+        return reader.read();
+    }
+    if (size.isValid()) {
+        if (size.width() > analysisSize.width() || size.height() > analysisSize.height()) {
+            // Lets the format scale while decoding where it can, e.g. JPEG's DCT scaling
+            reader.setScaledSize(size.scaled(analysisSize, Qt::KeepAspectRatio));
+        }
+        return reader.read();
+    }
+
+    // The size is not known upfront, at least bound the cost of sampling
+    const QImage image = reader.read();
+    if (image.width() > analysisSize.width() || image.height() > analysisSize.height()) {
+        return image.scaled(analysisSize, Qt::KeepAspectRatio, Qt::FastTransformation);
+    }
+    return image;
+}
+
+static inline int squareDistance(QRgb color1, QRgb color2)
+{
+    // https://en.wikipedia.org/wiki/Color_difference
+    // Using RGB distance for performance, as CIEDE2000 is too complicated
+    const int red = qRed(color1) - qRed(color2);
+    const int green = qGreen(color1) - qGreen(color2);
+    const int blue = qBlue(color1) - qBlue(color2);
+    if (red < 128) {
+        return 2 * red * red + 4 * green * green + 3 * blue * blue;
+    } else {
+        return 3 * red * red + 4 * green * green + 2 * blue * blue;
+    }
+}
+
+// Centroids as separate channels, so that the kernels can broadcast them
+struct CentroidChannels {
+    std::vector<float> r;
+    std::vector<float> g;
+    std::vector<float> b;
+
+    explicit CentroidChannels(const std::vector<QRgb> &centroids)
+    {
+        r.reserve(centroids.size());
+        g.reserve(centroids.size());
+        b.reserve(centroids.size());
+        for (QRgb centroid : centroids) {
+            r.push_back(qRed(centroid));
+            g.push_back(qGreen(centroid));
+            b.push_back(qBlue(centroid));
+        }
+    }
+
+    int size() const
+    {
+        return int(r.size());
+    }
+};
+
+// Stores in indexes the first centroid closer than s_minimumSquareDistance to
+// each sample, or -1. The kernels compare 4 or 8 samples at once to every
+// centroid in turn, until all of them found one. The distances are integers
+// below 2^24 and exact as floats, so all kernels give the same result.
+static void firstCloseCentroidsScalar(const QRgb *samples, qsizetype count, const std::vector<QRgb> &centroids, int *indexes)
+{
+    for (qsizetype i = 0; i < count; ++i) {
+        const QRgb rgb = samples[i];
+        auto it = std::find_if(centroids.cbegin(), centroids.cend(), [rgb](QRgb centroid) {
+            return squareDistance(rgb, centroid) < s_minimumSquareDistance;
+        });
+        indexes[i] = it == centroids.cend() ? -1 : int(std::distance(centroids.cbegin(), it));
+    }
+}
+
+#ifdef __SSE2__
+static void firstCloseCentroidsSse2(const QRgb *samples, qsizetype count, const std::vector<QRgb> &centroids, int *indexes)
+{
+    const CentroidChannels channels(centroids);
+    const __m128i channelMask = _mm_set1_epi32(0xff);
+    const __m128 threshold = _mm_set1_ps(s_minimumSquareDistance);
+    const __m128 swapLimit = _mm_set1_ps(128);
+    const __m128 two = _mm_set1_ps(2);
+    const __m128 three = _mm_set1_ps(3);
+    const __m128 four = _mm_set1_ps(4);
+
+    qsizetype i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + i));
+        const __m128 r = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(rgb, 16), channelMask));
+        const __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(rgb, 8), channelMask));
+        const __m128 b = _mm_cvtepi32_ps(_mm_and_si128(rgb, channelMask));
+
+        __m128i result = _mm_set1_epi32(-1);
+        __m128 pending = _mm_castsi128_ps(result);
+        for (int k = 0; k < channels.size(); ++k) {
+            const __m128 red = _mm_sub_ps(r, _mm_set1_ps(channels.r[k]));
+            const __m128 green = _mm_sub_ps(g, _mm_set1_ps(channels.g[k]));
+            const __m128 blue = _mm_sub_ps(b, _mm_set1_ps(channels.b[k]));
+            const __m128 red2 = _mm_mul_ps(red, red);
+            const __m128 blue2 = _mm_mul_ps(blue, blue);
+            // 2r² + 4g² + 3b², or 3r² + 4g² + 2b² when r >= 128
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(two, red2), _mm_mul_ps(four, _mm_mul_ps(green, green))), _mm_mul_ps(three, blue2));
+            distance = _mm_add_ps(distance, _mm_and_ps(_mm_cmpge_ps(red, swapLimit), _mm_sub_ps(red2, blue2)));
+
+            const __m128 found = _mm_and_ps(_mm_cmplt_ps(distance, threshold), pending);
+            if (_mm_movemask_ps(found)) {
+                const __m128i foundMask = _mm_castps_si128(found);
+                result = _mm_or_si128(_mm_andnot_si128(foundMask, result), _mm_and_si128(foundMask, _mm_set1_epi32(k)));
+                pending = _mm_andnot_ps(found, pending);
+                if (!_mm_movemask_ps(pending)) {
+                    break;
+                }
+            }
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(indexes + i), result);
+    }
+
+    firstCloseCentroidsScalar(samples + i, count - i, centroids, indexes + i);
+}
+#endif
+
+#if defined(__SSE2__) && QT_COMPILER_SUPPORTS_HERE(AVX2)
+QT_FUNCTION_TARGET(AVX2)
+static void firstCloseCentroidsAvx2(const QRgb *samples, qsizetype count, const std::vector<QRgb> &centroids, int *indexes)
+{
+    const CentroidChannels channels(centroids);
+    const __m256i channelMask = _mm256_set1_epi32(0xff);
+    const __m256 threshold = _mm256_set1_ps(s_minimumSquareDistance);
+    const __m256 swapLimit = _mm256_set1_ps(128);
+    const __m256 two = _mm256_set1_ps(2);
+    const __m256 three = _mm256_set1_ps(3);
+    const __m256 four = _mm256_set1_ps(4);
+
+    qsizetype i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i rgb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(samples + i));
+        const __m256 r = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(rgb, 16), channelMask));
+        const __m256 g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(rgb, 8), channelMask));
+        const __m256 b = _mm256_cvtepi32_ps(_mm256_and_si256(rgb, channelMask));
+
+        __m256i result = _mm256_set1_epi32(-1);
+        __m256 pending = _mm256_castsi256_ps(result);
+        for (int k = 0; k < channels.size(); ++k) {
+            const __m256 red = _mm256_sub_ps(r, _mm256_set1_ps(channels.r[k]));
+            const __m256 green = _mm256_sub_ps(g, _mm256_set1_ps(channels.g[k]));
+            const __m256 blue = _mm256_sub_ps(b, _mm256_set1_ps(channels.b[k]));
+            const __m256 red2 = _mm256_mul_ps(red, red);
+            const __m256 blue2 = _mm256_mul_ps(blue, blue);
+            // 2r² + 4g² + 3b², or 3r² + 4g² + 2b² when r >= 128
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(two, red2), _mm256_mul_ps(four, _mm256_mul_ps(green, green))), _mm256_mul_ps(three, blue2));
+            distance = _mm256_add_ps(distance, _mm256_and_ps(_mm256_cmp_ps(red, swapLimit, _CMP_GE_OQ), _mm256_sub_ps(red2, blue2)));
+
+            const __m256 found = _mm256_and_ps(_mm256_cmp_ps(distance, threshold, _CMP_LT_OQ), pending);
+            if (_mm256_movemask_ps(found)) {
+                result = _mm256_blendv_epi8(result, _mm256_set1_epi32(k), _mm256_castps_si256(found));
+                pending = _mm256_andnot_ps(found, pending);
+                if (!_mm256_movemask_ps(pending)) {
+                    break;
+                }
+            }
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(indexes + i), result);
+    }
+
+    firstCloseCentroidsScalar(samples + i, count - i, centroids, indexes + i);
+}
+#endif
+
+static void firstCloseCentroids(const QRgb *samples, qsizetype count, const std::vector<QRgb> &centroids, int *indexes)
+{
+#if defined(__SSE2__) && QT_COMPILER_SUPPORTS_HERE(AVX2)
+    if (qCpuHasFeature(AVX2)) {
+        firstCloseCentroidsAvx2(samples, count, centroids, indexes);
+        return;
+    }
+#endif
+#ifdef __SSE2__
+    firstCloseCentroidsSse2(samples, count, centroids, indexes);
+#else
+    firstCloseCentroidsScalar(samples, count, centroids, indexes);
+#endif
+}
+
+void ImageColorsEngine::positionColorMP(const decltype(ImageData::m_samples) &samples, decltype(ImageData::m_clusters) &clusters, int numCore)
+{
+    // Every sample joins the first cluster whose centroid is close enough, or
+    // starts a new cluster. Centroids don't move while samples are positioned,
+    // so samples can be positioned in parallel against the known centroids as
+    // long as new clusters are created in the order of the samples. Each block
+    // of samples is summed separately and the integer sums are added in block
+    // order, so the result does not depend on the number of threads.
+    struct Sums {
+        quint64 count = 0;
+        quint64 r = 0;
+        quint64 g = 0;
+        quint64 b = 0;
+    };
+
+    auto parallel = [numCore](qsizetype size) {
+#if HAVE_OpenMP
+        return size >= 65536 /* 256^2 */ && numCore > 1;
+#else
+        Q_UNUSED(size);
+        Q_UNUSED(numCore);
+        return false;
+#endif
+    };
+
+    // Positions the samples against the given centroids, returning the ones that are not close to any
+    auto position = [&parallel, numCore](const QList<QRgb> &input, const std::vector<QRgb> &centroids, std::vector<Sums> &sums) {
+        const bool isParallel = parallel(input.size());
+        const int numBlocks = isParallel ? numCore : 1;
+        std::vector<std::vector<Sums>> blockSums(numBlocks, std::vector<Sums>(centroids.size()));
+        std::vector<QList<QRgb>> blockRemaining(numBlocks);
+
+#pragma omp parallel for schedule(static) if (isParallel)
+        for (int i = 0; i < numBlocks; ++i) {
+            const qsizetype begin = input.size() * i / numBlocks;
+            const qsizetype end = input.size() * (i + 1) / numBlocks;
+            std::vector<int> indexes(end - begin);
+            firstCloseCentroids(input.constData() + begin, end - begin, centroids, indexes.data());
+            for (qsizetype j = begin; j < end; ++j) {
+                const QRgb rgb = input[j];
+                const int index = indexes[j - begin];
+                if (index < 0) {
+                    blockRemaining[i] << rgb;
+                    continue;
+                }
+                auto &sum = blockSums[i][index];
+                ++sum.count;
+                sum.r += qRed(rgb);
+                sum.g += qGreen(rgb);
+                sum.b += qBlue(rgb);
+            }
+        } // END omp parallel for
+
+        sums.assign(centroids.size(), {});
+        QList<QRgb> remaining;
+        for (int i = 0; i < numBlocks; ++i) {
+            for (std::size_t k = 0; k < centroids.size(); ++k) {
+                sums[k].count += blockSums[i][k].count;
+                sums[k].r += blockSums[i][k].r;
+                sums[k].g += blockSums[i][k].g;
+                sums[k].b += blockSums[i][k].b;
+            }
+            remaining.append(blockRemaining[i]);
+        }
+        return remaining;
+    };
+
+    auto add = [](ImageData::colorStat &stat, const Sums &sum) {
+        stat.count += sum.count;
+        stat.r += sum.r;
+        stat.g += sum.g;
+        stat.b += sum.b;
+    };
+
+    std::vector<QRgb> centroids;
+    centroids.reserve(clusters.size());
+    for (const auto &stat : std::as_const(clusters)) {
+        centroids.push_back(stat.centroid);
+    }
+
+    std::vector<Sums> sums;
+    QList<QRgb> remaining = position(samples, centroids, sums);
+    for (qsizetype k = 0; k < clusters.size(); ++k) {
+        add(clusters[k], sums[k]);
+    }
+
+    // The first remaining sample starts the next cluster, which takes all the
+    // remaining samples close to it. They are not close to any earlier cluster.
+    while (!remaining.isEmpty()) {
+        ImageData::colorStat stat;
+        stat.centroid = remaining.first();
+        remaining = position(remaining, {stat.centroid}, sums);
+        add(stat, sums.front());
+        clusters << stat;
+    }
+}
+
+// 5 bits per channel
+static constexpr int s_histogramSize = 1 << 15;
+
+static inline int histogramIndex(QRgb rgb)
+{
+    return ((qRed(rgb) >> 3) << 10) | ((qGreen(rgb) >> 3) << 5) | (qBlue(rgb) >> 3);
+}
+
+static inline QRgb histogramBinColor(int index, const ImageData::histogramBin &bin)
+{
+    // Mean color of the bin
+    return qRgb((((index >> 10) & 0x1f) << 3) + bin.r / bin.count, //
+                (((index >> 5) & 0x1f) << 3) + bin.g / bin.count, //
+                ((index & 0x1f) << 3) + bin.b / bin.count);
+}
+
+// CIELAB chroma at the center of every 15-bit color, indexed like the histogram
+static const std::array<float, s_histogramSize> &chromaTable()
+{
+    static const std::array<float, s_histogramSize> table = [] {
+        std::array<float, s_histogramSize> table;
+        for (int i = 0; i < s_histogramSize; ++i) {
+            table[i] = ColorUtils::chroma(QColor(((i >> 10) << 3) + 4, (((i >> 5) & 0x1f) << 3) + 4, ((i & 0x1f) << 3) + 4));
+        }
+        return table;
+    }();
+    return table;
+}
+
+// Whether a pixel is colorful enough to be sampled
+static inline bool isColorful(QRgb rgb, const std::array<float, s_histogramSize> &chromaTable)
+{
+    constexpr float threshold = 20;
+    // Within a 15-bit bin the chroma differs from the one at its center by less
+    // than 6.4 (checked over all 24-bit colors), so outside of this margin the
+    // table gives the same answer as the exact computation.
+    constexpr float margin = 8;
+
+    const float chroma = chromaTable[histogramIndex(rgb)];
+    if (std::abs(chroma - threshold) > margin) {
+        return chroma >= threshold;
+    }
+    return ColorUtils::chroma(QColor::fromRgb(rgb)) >= threshold;
+}
+
+static inline bool canceled(const std::function<bool()> &isCanceled)
+{
+    return isCanceled && isCanceled();
+}
+
+static void sampleScanLines(const QImage &image, int firstLine, int lastLine, PaletteWorkspace::Block &buffer, const std::function<bool()> &isCanceled)
+{
+    const int width = image.width();
+    const auto &chromas = chromaTable();
+    // Opaque pixels of the current line, compacted without branching
+    std::vector<QRgb> opaque(width);
+
+    // Artwork tends to have large flat areas, so remember the last verdict
+    // instead of looking up the same color over and over.
+    QRgb lastRgb = 0; // never matches, samples are opaque
+    bool lastAccepted = false;
+
+    for (int y = firstLine; y < lastLine; ++y) {
+        if (canceled(isCanceled)) {
+            return;
+        }
+
+        const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(y));
+
+        int count = 0;
+        for (int x = 0; x < width; ++x) {
+            const QRgb rgb = line[x];
+            opaque[count] = rgb | 0xff000000;
+            count += qAlpha(rgb) != 0;
+        }
+
+        for (int x = 0; x < count; ++x) {
+            const QRgb rgb = opaque[x];
+            if (rgb != lastRgb) {
+                lastRgb = rgb;
+                lastAccepted = isColorful(rgb, chromas);
+            }
+            if (!lastAccepted) {
+                continue;
+            }
+            ++buffer.count;
+            buffer.r += qRed(rgb);
+            buffer.g += qGreen(rgb);
+            buffer.b += qBlue(rgb);
+            buffer.samples << rgb;
+        }
+    }
+}
+
+void ImageColorsEngine::clusterHistogram(const std::vector<ImageData::histogramBin> &histogram, decltype(ImageData::m_clusters) &clusters)
+{
+    struct Bin {
+        QRgb color;
+        quint32 count;
+        int cluster;
+    };
+
+    std::vector<Bin> bins;
+    for (int i = 0; i < s_histogramSize; ++i) {
+        if (histogram[i].count > 0) {
+            bins.push_back({histogramBinColor(i, histogram[i]), histogram[i].count, -1});
+        }
+    }
+    // Seed from the most populated bins first; stable so the result only depends on the image
+    std::stable_sort(bins.begin(), bins.end(), [](const Bin &a, const Bin &b) {
+        return a.count > b.count;
+    });
+
+    std::vector<QRgb> centroids;
+    for (auto &bin : bins) {
+        for (std::size_t i = 0; i < centroids.size(); ++i) {
+            if (squareDistance(bin.color, centroids[i]) < s_minimumSquareDistance) {
+                bin.cluster = i;
+                break;
+            }
+        }
+        if (bin.cluster < 0) {
+            bin.cluster = centroids.size();
+            centroids.push_back(bin.color);
+        }
+    }
+
+    struct Accumulator {
+        qint64 r = 0;
+        qint64 g = 0;
+        qint64 b = 0;
+        qint64 count = 0;
+    };
+    std::vector<Accumulator> accumulators;
+    qint64 total = 0;
+
+    for (int iteration = 0; iteration < 5; ++iteration) {
+        // Move every centroid to the weighted mean of its bins
+        accumulators.assign(centroids.size(), {});
+        total = 0;
+        for (const auto &bin : bins) {
+            auto &acc = accumulators[bin.cluster];
+            acc.r += qint64(qRed(bin.color)) * bin.count;
+            acc.g += qint64(qGreen(bin.color)) * bin.count;
+            acc.b += qint64(qBlue(bin.color)) * bin.count;
+            acc.count += bin.count;
+            total += bin.count;
+        }
+        for (std::size_t i = 0; i < centroids.size(); ++i) {
+            const auto &acc = accumulators[i];
+            if (acc.count > 0) {
+                centroids[i] = qRgb(acc.r / acc.count, acc.g / acc.count, acc.b / acc.count);
+            }
+        }
+
+        // Then assign every bin to its nearest centroid
+        for (auto &bin : bins) {
+            int minimumDistance = std::numeric_limits<int>::max();
+            for (std::size_t i = 0; i < centroids.size(); ++i) {
+                if (accumulators[i].count == 0) {
+                    continue; // Dropped
+                }
+                const int distance = squareDistance(bin.color, centroids[i]);
+                if (distance < minimumDistance) {
+                    minimumDistance = distance;
+                    bin.cluster = i;
+                }
+            }
+        }
+    }
+
+    accumulators.assign(centroids.size(), {});
+    for (const auto &bin : bins) {
+        accumulators[bin.cluster].count += bin.count;
+    }
+
+    for (std::size_t i = 0; i < centroids.size(); ++i) {
+        if (accumulators[i].count == 0) {
+            continue;
+        }
+        ImageData::colorStat stat;
+        stat.centroid = centroids[i];
+        stat.ratio = std::clamp(qreal(accumulators[i].count) / qreal(total), 0.0, 1.0);
+        clusters << stat;
+    }
+}
+
+ImageData ImageColorsEngine::generatePalette(const QImage &sourceImage, Quantizer quantizer, const std::function<bool()> &isCanceled, PaletteWorkspace *workspace)
+{
+    // Palette jobs run on a small set of long-lived threads, so keep the
+    // buffers of each thread around instead of allocating them for every image.
+    // They are freed when the thread expires.
+    static thread_local PaletteWorkspace threadWorkspace;
+    if (!workspace) {
+        workspace = &threadWorkspace;
+    }
+
+    ImageData imageData;
+
+    if (sourceImage.isNull() || sourceImage.width() == 0) {
+        return imageData;
+    }
+
+    imageData.m_clusters.clear();
+    imageData.m_samples.clear();
+
+#if HAVE_OpenMP
+    // Several jobs run at the same time, share the cores between them rather
+    // than starting a full team of threads for each job.
+    const int numCore = std::max(1, std::min(8, omp_get_num_procs()) / s_concurrentJobs);
+    omp_set_num_threads(numCore);
+#else
+    constexpr int numCore = 1;
+#endif
+
+    // Work on 32-bit unpremultiplied pixels so that samples can be read straight
+    // from the scanlines. This is a no-op for the formats we usually get.
+    QImage image = sourceImage;
+    if (image.format() != QImage::Format_ARGB32 && image.format() != QImage::Format_RGB32) {
+        image.convertTo(QImage::Format_ARGB32);
+    }
+
+    // Each block of scanlines is sampled into its own buffer, the buffers are
+    // then concatenated in order, so no locking is needed while sampling and
+    // the samples always end up in row-major order.
+    const int numBlocks = std::min(numCore, image.height());
+    auto &buffers = workspace->blocks;
+    buffers.resize(numBlocks);
+    for (auto &buffer : buffers) {
+        buffer.samples.clear();
+        buffer.count = 0;
+        buffer.r = 0;
+        buffer.g = 0;
+        buffer.b = 0;
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < numBlocks; ++i) {
+        const int firstLine = image.height() * i / numBlocks;
+        const int lastLine = image.height() * (i + 1) / numBlocks;
+        sampleScanLines(image, firstLine, lastLine, buffers[i], isCanceled);
+    } // END omp parallel for
+
+    if (canceled(isCanceled)) {
+        return {};
+    }
+
+    qint64 sampleCount = 0;
+    qint64 sumR = 0;
+    qint64 sumG = 0;
+    qint64 sumB = 0;
+    for (const auto &buffer : buffers) {
+        sampleCount += buffer.count;
+        sumR += buffer.r;
+        sumG += buffer.g;
+        sumB += buffer.b;
+    }
+
+    if (sampleCount == 0) {
+        return imageData;
+    }
+
+    imageData.m_average = QColor(sumR / sampleCount, sumG / sampleCount, sumB / sampleCount, 255);
+
+    if (quantizer == Histogram) {
+        // A histogram per block would take 512 KiB each, so the blocks only
+        // collect samples, which are then binned in a single histogram.
+        auto &histogram = workspace->histogram;
+        if (histogram.size() != std::size_t(s_histogramSize)) {
+            histogram.assign(s_histogramSize, {});
+        } else {
+            // Most images only use a fraction of the bins, don't clear the whole histogram
+            for (const int index : workspace->usedBins) {
+                histogram[index] = {};
+            }
+        }
+        workspace->usedBins.clear();
+
+        for (const auto &buffer : buffers) {
+            for (const QRgb rgb : buffer.samples) {
+                const int index = histogramIndex(rgb);
+                auto &bin = histogram[index];
+                if (bin.count++ == 0) {
+                    workspace->usedBins.push_back(index);
+                }
+                bin.r += qRed(rgb) & 0x7;
+                bin.g += qGreen(rgb) & 0x7;
+                bin.b += qBlue(rgb) & 0x7;
+            }
+        }
+        clusterHistogram(histogram, imageData.m_clusters);
+    } else {
+        // Reuse the allocation of the previous run
+        imageData.m_samples.swap(workspace->samples);
+        imageData.m_samples.clear();
+        imageData.m_samples.reserve(sampleCount);
+        for (const auto &buffer : buffers) {
+            imageData.m_samples.append(buffer.samples);
+        }
+
+        positionColorMP(imageData.m_samples, imageData.m_clusters, numCore);
+
+        for (int iteration = 0; iteration < 5; ++iteration) {
+            if (canceled(isCanceled)) {
+                return {};
+            }
+
+            for (auto &stat : imageData.m_clusters) {
+                stat.centroid = qRgb(stat.r / stat.count, stat.g / stat.count, stat.b / stat.count);
+                stat.ratio = std::clamp(qreal(stat.count) / qreal(imageData.m_samples.count()), 0.0, 1.0);
+                // The centroid counts as a sample of the next pass
+                stat.count = 1;
+                stat.r = qRed(stat.centroid);
+                stat.g = qGreen(stat.centroid);
+                stat.b = qBlue(stat.centroid);
+            }
+
+            positionColorMP(imageData.m_samples, imageData.m_clusters, numCore);
+        }
+
+        // The samples are not needed anymore, don't keep them around with the palette
+        imageData.m_samples.swap(workspace->samples);
+    }
+
+    if (canceled(isCanceled)) {
+        return {};
+    }
+
+    // Clusters are ranked by their ratio times their chroma
+    auto centroidColors = [&imageData]() {
+        QList<QColor> colors;
+        colors.reserve(imageData.m_clusters.size());
+        for (const auto &stat : std::as_const(imageData.m_clusters)) {
+            colors << QColor(stat.centroid);
+        }
+        return colors;
+    };
+    {
+        const QList<qreal> chromas = ColorUtils::chromas(centroidColors());
+        std::vector<std::pair<qreal, ImageData::colorStat>> ranked;
+        ranked.reserve(imageData.m_clusters.size());
+        for (qsizetype i = 0; i < imageData.m_clusters.size(); ++i) {
+            ranked.emplace_back(imageData.m_clusters[i].ratio * chromas[i], imageData.m_clusters[i]);
+        }
+        std::sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b) {
+            return a.first > b.first;
+        });
+        for (qsizetype i = 0; i < imageData.m_clusters.size(); ++i) {
+            imageData.m_clusters[i] = ranked[i].second;
+        }
+    }
+
+    // compress blocks that became too similar
+    auto sourceIt = imageData.m_clusters.end();
+    // Use index instead of iterator, because QList::erase may invalidate iterator.
+    std::vector<int> itemsToDelete;
+    while (sourceIt != imageData.m_clusters.begin()) {
+        sourceIt--;
+        for (auto destIt = imageData.m_clusters.begin(); destIt != imageData.m_clusters.end() && destIt != sourceIt; destIt++) {
+            if (squareDistance((*sourceIt).centroid, (*destIt).centroid) < s_minimumSquareDistance) {
+                const qreal ratio = (*sourceIt).ratio / (*destIt).ratio;
+                const int r = ratio * qreal(qRed((*sourceIt).centroid)) + (1 - ratio) * qreal(qRed((*destIt).centroid));
+                const int g = ratio * qreal(qGreen((*sourceIt).centroid)) + (1 - ratio) * qreal(qGreen((*destIt).centroid));
+                const int b = ratio * qreal(qBlue((*sourceIt).centroid)) + (1 - ratio) * qreal(qBlue((*destIt).centroid));
+                (*destIt).ratio += (*sourceIt).ratio;
+                (*destIt).centroid = qRgb(r, g, b);
+                itemsToDelete.push_back(std::distance(imageData.m_clusters.begin(), sourceIt));
+                break;
+            }
+        }
+    }
+    for (auto i : std::as_const(itemsToDelete)) {
+        imageData.m_clusters.removeAt(i);
+    }
+
+    imageData.m_highlight = QColor();
+    imageData.m_dominant = QColor(imageData.m_clusters.first().centroid);
+    imageData.m_closestToBlack = Qt::white;
+    imageData.m_closestToWhite = Qt::black;
+
+    imageData.m_palette.clear();
+
+    // Of the merged clusters
+    const QList<qreal> chromas = ColorUtils::chromas(centroidColors());
+    qreal highlightChroma = 0;
+
+    bool first = true;
+
+#pragma omp parallel for ordered
+    for (int i = 0; i < imageData.m_clusters.size(); ++i) {
+        const auto &stat = imageData.m_clusters[i];
+        const QColor color(stat.centroid);
+
+        QColor contrast = QColor(255 - color.red(), 255 - color.green(), 255 - color.blue());
+        contrast.setHsl(contrast.hslHue(), //
+                        contrast.hslSaturation(), //
+                        128 + (128 - contrast.lightness()));
+        QColor tempContrast;
+        int minimumDistance = 4681800; // max distance: 4*3*2*3*255*255
+        for (const auto &stat : std::as_const(imageData.m_clusters)) {
+            const int distance = squareDistance(contrast.rgb(), stat.centroid);
+
+            if (distance < minimumDistance) {
+                tempContrast = QColor(stat.centroid);
+                minimumDistance = distance;
+            }
+        }
+
+        if (imageData.m_clusters.size() <= 3) {
+            if (qGray(imageData.m_dominant.rgb()) < 120) {
+                contrast = QColor(230, 230, 230);
+            } else {
+                contrast = QColor(20, 20, 20);
+            }
+            // TODO: replace m_clusters.size() > 3 with entropy calculation
+        } else if (squareDistance(contrast.rgb(), tempContrast.rgb()) < s_minimumSquareDistance * 1.5) {
+            contrast = tempContrast;
+        } else {
+            contrast = tempContrast;
+            contrast.setHsl(contrast.hslHue(),
+                            contrast.hslSaturation(),
+                            contrast.lightness() > 128 ? qMin(contrast.lightness() + 20, 255) : qMax(0, contrast.lightness() - 20));
+        }
+
+#pragma omp ordered
+        { // BEGIN omp ordered
+            if (first) {
+                imageData.m_dominantContrast = contrast;
+                imageData.m_dominant = color;
+            }
+            first = false;
+
+            if (!imageData.m_highlight.isValid() || chromas[i] > highlightChroma) {
+                imageData.m_highlight = color;
+                highlightChroma = chromas[i];
+            }
+
+            if (qGray(color.rgb()) > qGray(imageData.m_closestToWhite.rgb())) {
+                imageData.m_closestToWhite = color;
+            }
+            if (qGray(color.rgb()) < qGray(imageData.m_closestToBlack.rgb())) {
+                imageData.m_closestToBlack = color;
+            }
+            imageData.m_palette << PaletteSwatch(stat.ratio, color, contrast);
+        } // END omp ordered
+    }
+
+    return imageData;
+}
+
+bool ImageColorsEngine::isSimilar(const ImageData &a, const ImageData &b)
+{
+    if (a.m_palette.isEmpty() || b.m_palette.isEmpty()) {
+        return a.m_palette.isEmpty() == b.m_palette.isEmpty();
+    }
+    if (a.paletteBrightness() != b.paletteBrightness()) {
+        return false;
+    }
+
+    // A quarter of the distance at which clusters are merged
+    auto close = [](const QColor &color1, const QColor &color2) {
+        return squareDistance(color1.rgb(), color2.rgb()) < s_minimumSquareDistance / 4;
+    };
+    return close(a.m_dominant, b.m_dominant) && close(a.m_average, b.m_average) && close(a.m_highlight, b.m_highlight)
+        && close(a.m_dominantContrast, b.m_dominantContrast) && close(a.foreground(), b.foreground()) && close(a.background(), b.background());
+}
+
+void ImageColorsEngine::postProcess(ImageData &imageData, const QColor &backgroundColor, const QColor &textColor)
+{
+    constexpr short unsigned WCAG_NON_TEXT_CONTRAST_RATIO = 3;
+    constexpr qreal WCAG_TEXT_CONTRAST_RATIO = 4.5;
+
+    const qreal backgroundLum = ColorUtils::luminance(backgroundColor);
+    qreal lowerLum, upperLum;
+    // 192 is from kcm_colors
+    if (qGray(backgroundColor.rgb()) < 192) {
+        // (lowerLum + 0.05) / (backgroundLum + 0.05) >= 3
+        lowerLum = WCAG_NON_TEXT_CONTRAST_RATIO * (backgroundLum + 0.05) - 0.05;
+        upperLum = 0.95;
+    } else {
+        // For light themes, still prefer lighter colors
+        // (lowerLum + 0.05) / (textLum + 0.05) >= 4.5
+        const qreal textLum = ColorUtils::luminance(textColor);
+        lowerLum = WCAG_TEXT_CONTRAST_RATIO * (textLum + 0.05) - 0.05;
+        upperLum = backgroundLum;
+    }
+
+    auto adjustSaturation = [](QColor &color) {
+        // Adjust saturation to make the color more vibrant
+        if (color.hsvSaturationF() < 0.5) {
+            const qreal h = color.hsvHueF();
+            const qreal v = color.valueF();
+            color.setHsvF(h, 0.5, v);
+        }
+    };
+    adjustSaturation(imageData.m_dominant);
+    adjustSaturation(imageData.m_highlight);
+    adjustSaturation(imageData.m_average);
+
+    imageData.m_dominant = ColorUtils::adjustLuminance(imageData.m_dominant, lowerLum, upperLum);
+    imageData.m_highlight = ColorUtils::adjustLuminance(imageData.m_highlight, lowerLum, upperLum);
+    imageData.m_average = ColorUtils::adjustLuminance(imageData.m_average, lowerLum, upperLum);
+}
+
+#include "moc_imagecolorsengine.cpp"
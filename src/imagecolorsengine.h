@@ -0,0 +1,168 @@
+/*
+ *  SPDX-FileCopyrightText: 2020 Marco Martin <mart@kde.org>
+ *  SPDX-FileCopyrightText: 2024 ivan tkachenko <me@ratijas.tk>
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <QColor>
+#include <QImage>
+#include <QList>
+#include <QObject>
+#include <QSize>
+#include <QString>
+
+#include <functional>
+#include <vector>
+
+#include <platform/colorutils.h>
+
+// Registered in QML by imagecolors.h
+struct PaletteSwatch {
+    Q_GADGET
+
+    Q_PROPERTY(qreal ratio READ ratio FINAL)
+    Q_PROPERTY(QColor color READ color FINAL)
+    Q_PROPERTY(QColor contrastColor READ contrastColor FINAL)
+
+public:
+    explicit PaletteSwatch();
+    explicit PaletteSwatch(qreal ratio, const QColor &color, const QColor &contrastColor);
+
+    qreal ratio() const;
+    const QColor &color() const;
+    const QColor &contrastColor() const;
+
+    bool operator==(const PaletteSwatch &other) const;
+
+private:
+    qreal m_ratio;
+    QColor m_color;
+    QColor m_contrastColor;
+};
+
+struct ImageData {
+    struct colorStat {
+        QRgb centroid = 0;
+        qreal ratio = 0;
+        // Sums of the colors assigned to the cluster
+        quint64 count = 0;
+        quint64 r = 0;
+        quint64 g = 0;
+        quint64 b = 0;
+    };
+
+    struct histogramBin {
+        quint32 count = 0;
+        // Sums of the lower 3 bits of each channel, the upper 5 bits are given by the bin index
+        quint32 r = 0;
+        quint32 g = 0;
+        quint32 b = 0;
+    };
+
+    struct colorSet {
+        QColor average;
+        QColor text;
+        QColor background;
+        QColor highlight;
+    };
+
+    QList<QRgb> m_samples;
+    QList<colorStat> m_clusters;
+    QList<PaletteSwatch> m_palette;
+
+    bool m_darkPalette = true;
+    QColor m_dominant = Qt::transparent;
+    QColor m_dominantContrast;
+    QColor m_average;
+    QColor m_highlight;
+
+    QColor m_closestToBlack;
+    QColor m_closestToWhite;
+
+    ColorUtils::Brightness paletteBrightness() const;
+    QColor foreground() const;
+    QColor background() const;
+};
+
+/**
+ * Scratch buffers of ImageColorsEngine::generatePalette(), which can be reused to
+ * avoid allocating them again for every image when processing many images.
+ */
+struct PaletteWorkspace {
+    // Samples of a block of scanlines
+    struct Block {
+        QList<QRgb> samples;
+
+        qint64 count = 0;
+        qint64 r = 0;
+        qint64 g = 0;
+        qint64 b = 0;
+    };
+
+    std::vector<Block> blocks;
+    QList<QRgb> samples;
+    // The samples of all the blocks, for the histogram quantizer
+    std::vector<ImageData::histogramBin> histogram;
+    // The histogram bins in use, only these need to be cleared
+    std::vector<quint16> usedBins;
+};
+
+/**
+ * The palette extraction behind ImageColors, without any dependency on QObject or QML.
+ *
+ * All functions are thread-safe and can be called from any thread, e.g. to
+ * precompute palettes offline, see the kirigami-imagecolors tool.
+ */
+class ImageColorsEngine
+{
+public:
+    enum Quantizer {
+        Clustering,
+        Histogram,
+    };
+
+    /**
+     * Decodes the image file at @p path, at no more than @p analysisSize if it is valid.
+     */
+    static QImage loadImage(const QString &path, const QSize &analysisSize);
+
+    /**
+     * Extracts the palette of @p image.
+     *
+     * @p isCanceled is polled regularly, an empty palette is returned once it returns true.
+     * Passing the same @p workspace for consecutive images avoids allocating the
+     * sampling buffers again. Without one, the buffers of the calling thread are reused.
+     */
+    static ImageData
+    generatePalette(const QImage &image, Quantizer quantizer, const std::function<bool()> &isCanceled = {}, PaletteWorkspace *workspace = nullptr);
+
+    /**
+     * Adjusts the dominant, highlight and average colors of @p imageData so they
+     * contrast enough with a theme of the given colors.
+     */
+    static void postProcess(ImageData &imageData, const QColor &backgroundColor, const QColor &textColor);
+
+    /**
+     * Whether @p a and @p b would look alike to the user: they have the same
+     * brightness and their dominant, average, highlight and foreground and
+     * background colors are close. The individual swatches are not compared.
+     */
+    static bool isSimilar(const ImageData &a, const ImageData &b);
+
+    /**
+     * Sets how many palettes are generated at the same time, the threads used
+     * by generatePalette() are shared between them.
+     */
+    static void setConcurrentJobs(int jobs);
+
+private:
+    static void positionColorMP(const decltype(ImageData::m_samples) &samples, decltype(ImageData::m_clusters) &clusters, int numCore = 0);
+    static void clusterHistogram(const std::vector<ImageData::histogramBin> &histogram, decltype(ImageData::m_clusters) &clusters);
+
+    // Arbitrary number that seems to work well
+    static const int s_minimumSquareDistance = 32000;
+};
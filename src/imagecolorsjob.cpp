@@ -0,0 +1,66 @@
+/*
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include "imagecolorsjob.h"
+
+#include <QCoreApplication>
+#include <QThread>
+
+#include <algorithm>
+#include <atomic>
+
+Q_GLOBAL_STATIC(QThreadPool, s_threadPool)
+
+ImageColorsJob::ImageColorsJob(Function &&function)
+    : m_function(std::move(function))
+{
+}
+
+QFuture<ImageData> ImageColorsJob::start(Function &&function)
+{
+    // Newer requests take precedence, see the class documentation
+    static std::atomic<int> s_priority = 0;
+
+    auto job = new ImageColorsJob(std::move(function));
+    QFuture<ImageData> future = job->m_promise.future();
+    threadPool()->start(job, ++s_priority & 0x7fffffff);
+    return future;
+}
+
+QThreadPool *ImageColorsJob::threadPool()
+{
+    static const bool initialized = []() {
+        s_threadPool->setMaxThreadCount(std::clamp(QThread::idealThreadCount() / 2, 1, 4));
+        s_threadPool->setObjectName(QStringLiteral("ImageColors"));
+        ImageColorsEngine::setConcurrentJobs(s_threadPool->maxThreadCount());
+        if (auto app = QCoreApplication::instance()) {
+            // Don't hold up quitting with jobs nobody will see the result of
+            QObject::connect(app, &QCoreApplication::aboutToQuit, app, []() {
+                s_threadPool->clear();
+            });
+        }
+        return true;
+    }();
+    Q_UNUSED(initialized)
+
+    return s_threadPool;
+}
+
+void ImageColorsJob::run()
+{
+    m_promise.start();
+
+    if (!m_promise.isCanceled()) {
+        ImageData imageData = m_function([this]() {
+            return m_promise.isCanceled();
+        });
+        if (!m_promise.isCanceled()) {
+            m_promise.addResult(std::move(imageData));
+        }
+    }
+
+    m_promise.finish();
+}
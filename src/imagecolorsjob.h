@@ -0,0 +1,49 @@
+/*
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <QFuture>
+#include <QPromise>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <functional>
+
+#include "imagecolorsengine.h"
+
+/**
+ * A palette job running on the thread pool dedicated to ImageColors.
+ *
+ * Jobs are started with the most recent requests first, so while scrolling
+ * through a view the items that just became visible are served before the
+ * ones that were already scrolled past.
+ *
+ * Canceling the future of a job that has not started yet makes it return
+ * immediately. A running job is passed a function to poll, so it can stop
+ * at the next checkpoint.
+ */
+class ImageColorsJob : public QRunnable
+{
+public:
+    using Function = std::function<ImageData(const std::function<bool()> &isCanceled)>;
+
+    static QFuture<ImageData> start(Function &&function);
+
+    /**
+     * The pool palette jobs run on. It is deliberately smaller than the
+     * number of cores, since each job may use several threads on its own.
+     */
+    static QThreadPool *threadPool();
+
+    void run() override;
+
+private:
+    explicit ImageColorsJob(Function &&function);
+
+    Function m_function;
+    QPromise<ImageData> m_promise;
+};
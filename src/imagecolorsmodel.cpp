@@ -0,0 +1,340 @@
+/*
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include "imagecolorsmodel.h"
+
+#include <QUrl>
+
+#include <algorithm>
+#include <utility>
+
+#include "imagecolorscache.h"
+#include "platform/platformtheme.h"
+
+ImageColorsModel::ImageColorsModel(QObject *parent)
+    : QIdentityProxyModel(parent)
+    , m_results(1024)
+{
+    // Collects the rows requested during one pass of the event loop
+    m_queueTimer.setSingleShot(true);
+    m_queueTimer.setInterval(0);
+    connect(&m_queueTimer, &QTimer::timeout, this, &ImageColorsModel::processQueue);
+
+    connect(this, &QAbstractItemModel::modelReset, this, [this]() {
+        m_sourceRoleId = -1;
+        m_firstRole = -1;
+        dropRemovedRows();
+    });
+    connect(this, &QAbstractItemModel::rowsRemoved, this, &ImageColorsModel::dropRemovedRows);
+}
+
+ImageColorsModel::~ImageColorsModel()
+{
+    reset();
+}
+
+QString ImageColorsModel::sourceRole() const
+{
+    return m_sourceRole;
+}
+
+void ImageColorsModel::setSourceRole(const QString &role)
+{
+    if (m_sourceRole == role) {
+        return;
+    }
+
+    m_sourceRole = role;
+    m_sourceRoleId = -1;
+    invalidate();
+    Q_EMIT sourceRoleChanged();
+}
+
+QSize ImageColorsModel::analysisSize() const
+{
+    return m_analysisSize;
+}
+
+void ImageColorsModel::setAnalysisSize(const QSize &size)
+{
+    if (m_analysisSize == size) {
+        return;
+    }
+
+    m_analysisSize = size;
+    invalidate();
+    Q_EMIT analysisSizeChanged();
+}
+
+ImageColors::Quantizer ImageColorsModel::quantizer() const
+{
+    return m_quantizer;
+}
+
+void ImageColorsModel::setQuantizer(ImageColors::Quantizer quantizer)
+{
+    if (m_quantizer == quantizer) {
+        return;
+    }
+
+    m_quantizer = quantizer;
+    invalidate();
+    Q_EMIT quantizerChanged();
+}
+
+bool ImageColorsModel::persistentCache() const
+{
+    return m_persistentCache;
+}
+
+void ImageColorsModel::setPersistentCache(bool persistent)
+{
+    if (m_persistentCache == persistent) {
+        return;
+    }
+
+    // Palettes computed so far stay valid, only the next ones are affected
+    m_persistentCache = persistent;
+    Q_EMIT persistentCacheChanged();
+}
+
+void ImageColorsModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    reset();
+    m_sourceRoleId = -1;
+    m_firstRole = -1;
+    QIdentityProxyModel::setSourceModel(sourceModel);
+}
+
+void ImageColorsModel::updateRoles() const
+{
+    if (m_firstRole >= 0 || !sourceModel()) {
+        return;
+    }
+
+    const QHash<int, QByteArray> roles = sourceModel()->roleNames();
+    int firstRole = Qt::UserRole;
+    for (auto it = roles.cbegin(); it != roles.cend(); ++it) {
+        firstRole = std::max(firstRole, it.key() + 1);
+    }
+    m_sourceRoleId = roles.key(m_sourceRole.toUtf8(), -1);
+
+    // Don't settle on role ids before the source model knows its roles
+    if (!roles.isEmpty()) {
+        m_firstRole = firstRole;
+    }
+}
+
+QList<int> ImageColorsModel::colorRoles() const
+{
+    QList<int> roles;
+    if (m_firstRole >= 0) {
+        for (int role = 0; role < RoleCount; ++role) {
+            roles << m_firstRole + role;
+        }
+    }
+    return roles;
+}
+
+QHash<int, QByteArray> ImageColorsModel::roleNames() const
+{
+    QHash<int, QByteArray> roles = QIdentityProxyModel::roleNames();
+
+    updateRoles();
+    if (m_firstRole < 0) {
+        return roles;
+    }
+
+    roles.insert(m_firstRole + PaletteRole, QByteArrayLiteral("palette"));
+    roles.insert(m_firstRole + PaletteBrightnessRole, QByteArrayLiteral("paletteBrightness"));
+    roles.insert(m_firstRole + AverageRole, QByteArrayLiteral("average"));
+    roles.insert(m_firstRole + DominantRole, QByteArrayLiteral("dominant"));
+    roles.insert(m_firstRole + DominantContrastRole, QByteArrayLiteral("dominantContrast"));
+    roles.insert(m_firstRole + HighlightRole, QByteArrayLiteral("highlight"));
+    roles.insert(m_firstRole + ForegroundRole, QByteArrayLiteral("foreground"));
+    roles.insert(m_firstRole + BackgroundRole, QByteArrayLiteral("background"));
+    return roles;
+}
+
+QString ImageColorsModel::sourcePath(const QModelIndex &index) const
+{
+    if (m_sourceRoleId < 0) {
+        return QString();
+    }
+
+    // Interpreted like a string source of ImageColors
+    const QVariant source = QIdentityProxyModel::data(index, m_sourceRoleId);
+    const QString sourceString = source.canConvert<QUrl>() ? source.toUrl().toString() : source.toString();
+    if (auto url = QUrl(sourceString); url.isLocalFile()) {
+        return url.toLocalFile();
+    }
+    return sourceString;
+}
+
+QVariant ImageColorsModel::data(const QModelIndex &index, int role) const
+{
+    updateRoles();
+    if (m_firstRole < 0 || role < m_firstRole || role >= m_firstRole + RoleCount) {
+        return QIdentityProxyModel::data(index, role);
+    }
+
+    const QString path = sourcePath(index);
+    if (path.isEmpty()) {
+        return QVariant();
+    }
+
+    const ImageData *imageData = m_results.object(path);
+    if (!imageData) {
+        auto &waiting = m_waiting[path];
+        if (waiting.isEmpty()) {
+            m_queue << path;
+        }
+        if (!waiting.contains(index)) {
+            waiting << QPersistentModelIndex(index);
+        }
+        if (!m_queueTimer.isActive()) {
+            m_queueTimer.start();
+        }
+        return QVariant();
+    }
+
+    if (role == m_firstRole + PaletteRole) {
+        return QVariant::fromValue(imageData->m_palette);
+    }
+    if (imageData->m_palette.isEmpty()) {
+        return QVariant();
+    }
+
+    switch (role - m_firstRole) {
+    case PaletteBrightnessRole:
+        return QVariant::fromValue(imageData->paletteBrightness());
+    case AverageRole:
+        return imageData->m_average;
+    case DominantRole:
+        return imageData->m_dominant;
+    case DominantContrastRole:
+        return imageData->m_dominantContrast;
+    case HighlightRole:
+        return imageData->m_highlight;
+    case ForegroundRole:
+        return imageData->foreground();
+    case BackgroundRole:
+        return imageData->background();
+    }
+
+    return QVariant();
+}
+
+void ImageColorsModel::processQueue()
+{
+    const auto quantizer = ImageColorsEngine::Quantizer(m_quantizer);
+    // Results found in the cache are delivered right away, which may queue other rows
+    const QList<QString> queue = std::exchange(m_queue, {});
+    for (const QString &path : queue) {
+        const QString key = ImageColors::cacheKey(ImageColors::fileKey(path, m_analysisSize), m_quantizer);
+        if (auto imageData = ImageColorsCache::instance()->find(key, m_persistentCache)) {
+            setResult(path, *imageData);
+            continue;
+        }
+
+        auto job = [path, analysisSize = m_analysisSize, quantizer](const std::function<bool()> &isCanceled) {
+            // Palettes baked with kirigami-imagecolors don't need the image at all
+            if (auto imageData = ImageColorsCache::instance()->findInSidecar(path, analysisSize, quantizer)) {
+                return *imageData;
+            }
+            return ImageColorsEngine::generatePalette(ImageColorsEngine::loadImage(path, analysisSize), quantizer, isCanceled);
+        };
+
+        Running running;
+        running.request = ImageColorsCache::instance()->run(key, std::move(job), m_persistentCache);
+        running.watcher = new QFutureWatcher<ImageData>(this);
+        connect(running.watcher, &QFutureWatcher<ImageData>::finished, this, [this, path]() {
+            auto watcher = m_running.take(path).watcher;
+            watcher->deleteLater();
+            // Canceled jobs, e.g. when the application quits, have no result
+            if (!watcher->isCanceled() && watcher->future().resultCount() > 0) {
+                setResult(path, watcher->result());
+            }
+        });
+        running.watcher->setFuture(running.request.future);
+        m_running.insert(path, running);
+    }
+}
+
+void ImageColorsModel::setResult(const QString &path, ImageData imageData)
+{
+    auto platformTheme = static_cast<Kirigami::Platform::PlatformTheme *>(qmlAttachedPropertiesObject<Kirigami::Platform::PlatformTheme>(this, true));
+    if (!m_themeConnected) {
+        // Results are adjusted to the theme, compute them again when it changes
+        connect(platformTheme, &Kirigami::Platform::PlatformTheme::colorsChanged, this, &ImageColorsModel::invalidate);
+        m_themeConnected = true;
+    }
+    ImageColorsEngine::postProcess(imageData, platformTheme->backgroundColor(), platformTheme->textColor());
+    m_results.insert(path, new ImageData(std::move(imageData)));
+
+    const QList<int> roles = colorRoles();
+    const QList<QPersistentModelIndex> indexes = m_waiting.take(path);
+    for (const QPersistentModelIndex &index : indexes) {
+        if (index.isValid()) {
+            Q_EMIT dataChanged(index, index, roles);
+        }
+    }
+}
+
+void ImageColorsModel::release(const QString &path)
+{
+    auto it = m_running.find(path);
+    if (it == m_running.end()) {
+        return;
+    }
+
+    it->watcher->disconnect(this);
+    it->watcher->deleteLater();
+    ImageColorsCache::instance()->release(it->request);
+    m_running.erase(it);
+}
+
+void ImageColorsModel::dropRemovedRows()
+{
+    for (auto it = m_waiting.begin(); it != m_waiting.end();) {
+        it->removeIf([](const QPersistentModelIndex &index) {
+            return !index.isValid();
+        });
+        if (!it->isEmpty()) {
+            ++it;
+            continue;
+        }
+        // Nobody is waiting for this palette anymore
+        m_queue.removeOne(it.key());
+        release(it.key());
+        it = m_waiting.erase(it);
+    }
+}
+
+void ImageColorsModel::reset()
+{
+    const QList<QString> running = m_running.keys();
+    for (const QString &path : running) {
+        release(path);
+    }
+
+    m_queueTimer.stop();
+    m_queue.clear();
+    m_waiting.clear();
+    m_results.clear();
+}
+
+void ImageColorsModel::invalidate()
+{
+    reset();
+
+    updateRoles();
+    if (m_firstRole >= 0 && rowCount() > 0) {
+        Q_EMIT dataChanged(index(0, 0), index(rowCount() - 1, columnCount() - 1), colorRoles());
+    }
+}
+
+#include "moc_imagecolorsmodel.cpp"
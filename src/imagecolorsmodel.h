@@ -0,0 +1,167 @@
+/*
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <QCache>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QIdentityProxyModel>
+#include <QPersistentModelIndex>
+#include <QQmlEngine>
+#include <QSize>
+#include <QTimer>
+
+#include "imagecolors.h"
+
+/**
+ * A proxy model adding the colors of an image to every row of its source model.
+ *
+ * The image of a row is given by the role named `sourceRole`, which must hold a
+ * local file path or URL. Palettes are computed by the same jobs as the ones of
+ * ImageColors with a file source, so they share the cache and the jobs in flight,
+ * and the rows requested last, e.g. the delegates which just scrolled into view,
+ * are served first. Rows removed before their palette is available don't keep
+ * their job alive.
+ *
+ * The following roles are added after the roles of the source model, with the
+ * same meaning as the properties of ImageColors. Their ids depend on the roles of
+ * the source model, so they are only available by name:
+ * * `palette`
+ * * `paletteBrightness`
+ * * `average`
+ * * `dominant`
+ * * `dominantContrast`
+ * * `highlight`
+ * * `foreground`
+ * * `background`
+ *
+ * Until the palette of a row is available these roles are `undefined`. They stay
+ * `undefined`, except for an empty `palette`, for images without any colorful pixels.
+ *
+ * @code
+ * ListView {
+ *     model: Kirigami.ImageColorsModel {
+ *         sourceModel: albumModel
+ *         sourceRole: "coverUrl"
+ *     }
+ *     delegate: Rectangle {
+ *         required property color background
+ *         color: background
+ *     }
+ * }
+ * @endcode
+ *
+ * \since 6.8
+ */
+class ImageColorsModel : public QIdentityProxyModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+
+    /**
+     * The name of the role of the source model holding the image of each row.
+     */
+    Q_PROPERTY(QString sourceRole READ sourceRole WRITE setSourceRole NOTIFY sourceRoleChanged FINAL)
+
+    /**
+     * The resolution at which the images are analyzed, see ImageColors::analysisSize.
+     *
+     * default: `Qt.size(128, 128)`
+     */
+    Q_PROPERTY(QSize analysisSize READ analysisSize WRITE setAnalysisSize NOTIFY analysisSizeChanged FINAL)
+
+    /**
+     * The algorithm used to group the colors of the images, see ImageColors::quantizer.
+     *
+     * default: `ImageColors.Clustering`
+     */
+    Q_PROPERTY(ImageColors::Quantizer quantizer READ quantizer WRITE setQuantizer NOTIFY quantizerChanged FINAL)
+
+    /**
+     * Whether palettes should be kept in a cache on disk, see ImageColors::persistentCache.
+     *
+     * default: `false`
+     */
+    Q_PROPERTY(bool persistentCache READ persistentCache WRITE setPersistentCache NOTIFY persistentCacheChanged FINAL)
+
+public:
+    explicit ImageColorsModel(QObject *parent = nullptr);
+    ~ImageColorsModel() override;
+
+    QString sourceRole() const;
+    void setSourceRole(const QString &role);
+
+    QSize analysisSize() const;
+    void setAnalysisSize(const QSize &size);
+
+    ImageColors::Quantizer quantizer() const;
+    void setQuantizer(ImageColors::Quantizer quantizer);
+
+    bool persistentCache() const;
+    void setPersistentCache(bool persistent);
+
+    void setSourceModel(QAbstractItemModel *sourceModel) override;
+    QHash<int, QByteArray> roleNames() const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+Q_SIGNALS:
+    void sourceRoleChanged();
+    void analysisSizeChanged();
+    void quantizerChanged();
+    void persistentCacheChanged();
+
+private:
+    // The added roles, by their offset from the first role after those of the
+    // source model. Their ids depend on the source model, so they are only
+    // meant to be used by name.
+    enum Role {
+        PaletteRole,
+        PaletteBrightnessRole,
+        AverageRole,
+        DominantRole,
+        DominantContrastRole,
+        HighlightRole,
+        ForegroundRole,
+        BackgroundRole,
+        RoleCount,
+    };
+
+    struct Running {
+        ImageColorsRequest request;
+        QFutureWatcher<ImageData> *watcher = nullptr;
+    };
+
+    void updateRoles() const;
+    QList<int> colorRoles() const;
+    QString sourcePath(const QModelIndex &index) const;
+    void processQueue();
+    void setResult(const QString &path, ImageData imageData);
+    void release(const QString &path);
+    void dropRemovedRows();
+    void reset();
+    void invalidate();
+
+    QString m_sourceRole;
+    QSize m_analysisSize = QSize(128, 128);
+    ImageColors::Quantizer m_quantizer = ImageColors::Clustering;
+    bool m_persistentCache = false;
+
+    // Role ids are assigned lazily, the roles of a source model may only be known once it is filled
+    mutable int m_sourceRoleId = -1;
+    mutable int m_firstRole = -1;
+
+    // Theme-adjusted palettes by path, of the rows requested last. Others are
+    // adjusted again from ImageColorsCache when they are requested.
+    QCache<QString, ImageData> m_results;
+    // Rows waiting for the palette of a path, which is either queued or being computed
+    mutable QHash<QString, QList<QPersistentModelIndex>> m_waiting;
+    mutable QList<QString> m_queue;
+    mutable QTimer m_queueTimer;
+    // By path
+    QHash<QString, Running> m_running;
+    bool m_themeConnected = false;
+};
@@ -6,13 +6,72 @@
 
 #include "colorutils.h"
 
+#include <QHash>
 #include <QIcon>
 #include <QtMath>
+#include <array>
+#include <atomic>
 #include <cmath>
 #include <map>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include <private/qsimd_p.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
 #include "kirigamiplatform_logging.h"
 
+// Memoization of the blending functions, see ColorUtils::setCacheEnabled()
+enum class CachedOperation : quint8 {
+    None,
+    AlphaBlend,
+    LinearInterpolation,
+    TintWithAlpha,
+};
+
+struct CacheEntry {
+    CachedOperation operation = CachedOperation::None;
+    QColor one;
+    QColor two;
+    double parameter = 0.0;
+    QColor result;
+};
+
+// Direct-mapped, a result replaces the one hashed to the same slot before it
+static constexpr std::size_t s_cacheSize = 256;
+static std::atomic<bool> s_cacheEnabled = false;
+static std::atomic<qint64> s_cacheHits = 0;
+static std::atomic<qint64> s_cacheMisses = 0;
+
+template<typename Function>
+static QColor cached(CachedOperation operation, const QColor &one, const QColor &two, double parameter, Function &&function)
+{
+    if (!s_cacheEnabled.load(std::memory_order_relaxed)) {
+        return function();
+    }
+
+    // One per thread, so no locking is needed
+    thread_local std::unique_ptr<std::array<CacheEntry, s_cacheSize>> cache;
+    if (!cache) {
+        cache = std::make_unique<std::array<CacheEntry, s_cacheSize>>();
+    }
+
+    const std::size_t hash = qHashMulti(0, quint8(operation), quint64(one.rgba64()), quint64(two.rgba64()), parameter);
+    CacheEntry &entry = (*cache)[hash % s_cacheSize];
+    // QColor compares the color spec as well, conversions from another spec may give different results
+    if (entry.operation == operation && entry.parameter == parameter && entry.one == one && entry.two == two) {
+        s_cacheHits.fetch_add(1, std::memory_order_relaxed);
+        return entry.result;
+    }
+
+    s_cacheMisses.fetch_add(1, std::memory_order_relaxed);
+    entry = {operation, one, two, parameter, function()};
+    return entry.result;
+}
+
 ColorUtils::ColorUtils(QObject *parent)
     : QObject(parent)
 {
@@ -34,67 +93,58 @@ qreal ColorUtils::grayForColor(const QColor &color)
 
 QColor ColorUtils::alphaBlend(const QColor &foreground, const QColor &background)
 {
-    const auto foregroundAlpha = foreground.alpha();
-    const auto inverseForegroundAlpha = 0xff - foregroundAlpha;
-    const auto backgroundAlpha = background.alpha();
+    return cached(CachedOperation::AlphaBlend, foreground, background, 0.0, [&]() {
+        const auto foregroundAlpha = foreground.alpha();
+        const auto inverseForegroundAlpha = 0xff - foregroundAlpha;
+        const auto backgroundAlpha = background.alpha();
 
-    if (foregroundAlpha == 0x00) {
-        return background;
-    }
+        if (foregroundAlpha == 0x00) {
+            return background;
+        }
 
-    if (backgroundAlpha == 0xff) {
-        return QColor::fromRgb((foregroundAlpha * foreground.red()) + (inverseForegroundAlpha * background.red()),
-                               (foregroundAlpha * foreground.green()) + (inverseForegroundAlpha * background.green()),
-                               (foregroundAlpha * foreground.blue()) + (inverseForegroundAlpha * background.blue()),
-                               0xff);
-    } else {
-        const auto inverseBackgroundAlpha = (backgroundAlpha * inverseForegroundAlpha) / 255;
-        const auto finalAlpha = foregroundAlpha + inverseBackgroundAlpha;
-        Q_ASSERT(finalAlpha != 0x00);
-        return QColor::fromRgb((foregroundAlpha * foreground.red()) + (inverseBackgroundAlpha * background.red()),
-                               (foregroundAlpha * foreground.green()) + (inverseBackgroundAlpha * background.green()),
-                               (foregroundAlpha * foreground.blue()) + (inverseBackgroundAlpha * background.blue()),
-                               finalAlpha);
-    }
+        if (backgroundAlpha == 0xff) {
+            return QColor::fromRgb((foregroundAlpha * foreground.red()) + (inverseForegroundAlpha * background.red()),
+                                   (foregroundAlpha * foreground.green()) + (inverseForegroundAlpha * background.green()),
+                                   (foregroundAlpha * foreground.blue()) + (inverseForegroundAlpha * background.blue()),
+                                   0xff);
+        } else {
+            const auto inverseBackgroundAlpha = (backgroundAlpha * inverseForegroundAlpha) / 255;
+            const auto finalAlpha = foregroundAlpha + inverseBackgroundAlpha;
+            Q_ASSERT(finalAlpha != 0x00);
+            return QColor::fromRgb((foregroundAlpha * foreground.red()) + (inverseBackgroundAlpha * background.red()),
+                                   (foregroundAlpha * foreground.green()) + (inverseBackgroundAlpha * background.green()),
+                                   (foregroundAlpha * foreground.blue()) + (inverseBackgroundAlpha * background.blue()),
+                                   finalAlpha);
+        }
+    });
 }
 
 QColor ColorUtils::linearInterpolation(const QColor &one, const QColor &two, double balance)
 {
-    auto linearlyInterpolateDouble = [](double one, double two, double factor) {
-        return one + (two - one) * factor;
-    };
-
-    // QColor returns -1 when hue is undefined, which happens whenever
-    // saturation is 0. When this happens, interpolation can go wrong so handle
-    // it by first trying to use the other color's hue and if that is also -1,
-    // just skip the hue interpolation by using 0 for both.
-    auto sourceHue = std::max(one.hueF() > 0.0 ? one.hueF() : two.hueF(), 0.0f);
-    auto targetHue = std::max(two.hueF() > 0.0 ? two.hueF() : one.hueF(), 0.0f);
-
-    auto hue = std::fmod(linearlyInterpolateDouble(sourceHue, targetHue, balance), 1.0);
-    auto saturation = std::clamp(linearlyInterpolateDouble(one.saturationF(), two.saturationF(), balance), 0.0, 1.0);
-    auto value = std::clamp(linearlyInterpolateDouble(one.valueF(), two.valueF(), balance), 0.0, 1.0);
-    auto alpha = std::clamp(linearlyInterpolateDouble(one.alphaF(), two.alphaF(), balance), 0.0, 1.0);
-
-    return QColor::fromHsvF(hue, saturation, value, alpha);
+    return cached(CachedOperation::LinearInterpolation, one, two, balance, [&]() {
+        auto linearlyInterpolateDouble = [](double one, double two, double factor) {
+            return one + (two - one) * factor;
+        };
+
+        // QColor returns -1 when hue is undefined, which happens whenever
+        // saturation is 0. When this happens, interpolation can go wrong so handle
+        // it by first trying to use the other color's hue and if that is also -1,
+        // just skip the hue interpolation by using 0 for both.
+        auto sourceHue = std::max(one.hueF() > 0.0 ? one.hueF() : two.hueF(), 0.0f);
+        auto targetHue = std::max(two.hueF() > 0.0 ? two.hueF() : one.hueF(), 0.0f);
+
+        auto hue = std::fmod(linearlyInterpolateDouble(sourceHue, targetHue, balance), 1.0);
+        auto saturation = std::clamp(linearlyInterpolateDouble(one.saturationF(), two.saturationF(), balance), 0.0, 1.0);
+        auto value = std::clamp(linearlyInterpolateDouble(one.valueF(), two.valueF(), balance), 0.0, 1.0);
+        auto alpha = std::clamp(linearlyInterpolateDouble(one.alphaF(), two.alphaF(), balance), 0.0, 1.0);
+
+        return QColor::fromHsvF(hue, saturation, value, alpha);
+    });
 }
 
-// Some private things for the adjust, change, and scale properties
-struct ParsedAdjustments {
-    double red = 0.0;
-    double green = 0.0;
-    double blue = 0.0;
-
-    double hue = 0.0;
-    double saturation = 0.0;
-    double value = 0.0;
-
-    double alpha = 0.0;
-};
-
-ParsedAdjustments parseAdjustments(const QJSValue &value)
+static ColorAdjustment parseAdjustments(const QJSValue &value)
 {
-    ParsedAdjustments parsed;
+    ColorAdjustment parsed;
 
     auto checkProperty = [](const QJSValue &value, const QString &property) {
         if (value.hasProperty(property)) {
@@ -123,16 +173,24 @@ ParsedAdjustments parseAdjustments(const QJSValue &value)
         }
     }
 
-    if ((parsed.red || parsed.green || parsed.blue) && (parsed.hue || parsed.saturation || parsed.value)) {
+    return parsed;
+}
+
+static void checkAdjustments(const ColorAdjustment &adjusts)
+{
+    if ((adjusts.red || adjusts.green || adjusts.blue) && (adjusts.hue || adjusts.saturation || adjusts.value)) {
         qCCritical(KirigamiPlatform) << "It is an error to have both RGB and HSV values in an adjustment.";
     }
-
-    return parsed;
 }
 
 QColor ColorUtils::adjustColor(const QColor &color, const QJSValue &adjustments)
 {
-    auto adjusts = parseAdjustments(adjustments);
+    return adjustColor(color, parseAdjustments(adjustments));
+}
+
+QColor ColorUtils::adjustColor(const QColor &color, const ColorAdjustment &adjusts)
+{
+    checkAdjustments(adjusts);
 
     if (qBound(-360.0, adjusts.hue, 360.0) != adjusts.hue) {
         qCCritical(KirigamiPlatform) << "Hue is out of bounds";
@@ -178,7 +236,13 @@ QColor ColorUtils::adjustColor(const QColor &color, const QJSValue &adjustments)
 
 QColor ColorUtils::scaleColor(const QColor &color, const QJSValue &adjustments)
 {
-    auto adjusts = parseAdjustments(adjustments);
+    return scaleColor(color, parseAdjustments(adjustments));
+}
+
+QColor ColorUtils::scaleColor(const QColor &color, const ColorAdjustment &adjusts)
+{
+    checkAdjustments(adjusts);
+
     auto copy = color;
 
     if (qBound(-100.0, adjusts.red, 100.00) != adjusts.red) {
@@ -229,39 +293,72 @@ QColor ColorUtils::scaleColor(const QColor &color, const QJSValue &adjustments)
 
 QColor ColorUtils::tintWithAlpha(const QColor &targetColor, const QColor &tintColor, double alpha)
 {
-    qreal tintAlpha = tintColor.alphaF() * alpha;
-    qreal inverseAlpha = 1.0 - tintAlpha;
+    return cached(CachedOperation::TintWithAlpha, targetColor, tintColor, alpha, [&]() {
+        qreal tintAlpha = tintColor.alphaF() * alpha;
+        qreal inverseAlpha = 1.0 - tintAlpha;
+
+        if (qFuzzyCompare(tintAlpha, 1.0)) {
+            return tintColor;
+        } else if (qFuzzyIsNull(tintAlpha)) {
+            return targetColor;
+        }
+
+        return QColor::fromRgbF(tintColor.redF() * tintAlpha + targetColor.redF() * inverseAlpha,
+                                tintColor.greenF() * tintAlpha + targetColor.greenF() * inverseAlpha,
+                                tintColor.blueF() * tintAlpha + targetColor.blueF() * inverseAlpha,
+                                tintAlpha + inverseAlpha * targetColor.alphaF());
+    });
+}
 
-    if (qFuzzyCompare(tintAlpha, 1.0)) {
-        return tintColor;
-    } else if (qFuzzyIsNull(tintAlpha)) {
-        return targetColor;
+// Gamma correction, i.e. conversion from sRGB to linear-space
+static qreal srgbToLinear(qreal v)
+{
+    if (v > 0.04045) {
+        return std::pow((v + 0.055) / 1.055, 2.4);
     }
+    return v / 12.92;
+}
 
-    return QColor::fromRgbF(tintColor.redF() * tintAlpha + targetColor.redF() * inverseAlpha,
-                            tintColor.greenF() * tintAlpha + targetColor.greenF() * inverseAlpha,
-                            tintColor.blueF() * tintAlpha + targetColor.blueF() * inverseAlpha,
-                            tintAlpha + inverseAlpha * targetColor.alphaF());
+// srgbToLinear() of every 8-bit channel value
+static const std::array<qreal, 256> &srgbToLinearTable()
+{
+    static const std::array<qreal, 256> table = [] {
+        std::array<qreal, 256> table;
+        for (int i = 0; i < 256; ++i) {
+            table[i] = srgbToLinear(i / 255.0);
+        }
+        return table;
+    }();
+    return table;
+}
+
+// The sRGB channels of color in linear-space
+static void linearChannels(const QColor &color, qreal &r, qreal &g, qreal &b)
+{
+    if (color.spec() == QColor::ExtendedRgb) {
+        r = srgbToLinear(color.redF());
+        g = srgbToLinear(color.greenF());
+        b = srgbToLinear(color.blueF());
+    } else {
+        // Most colors come from 8-bit values, for which the conversion can be looked up
+        const auto &table = srgbToLinearTable();
+        auto correct = [&table](quint16 v) {
+            return v % 257 == 0 ? table[v / 257] : srgbToLinear(v / 65535.0);
+        };
+        const QRgba64 rgba = color.rgba64();
+        r = correct(rgba.red());
+        g = correct(rgba.green());
+        b = correct(rgba.blue());
+    }
 }
 
 ColorUtils::XYZColor ColorUtils::colorToXYZ(const QColor &color)
 {
     // http://wiki.nuaj.net/index.php/Color_Transforms#RGB_.E2.86.92_XYZ
-    qreal r = color.redF();
-    qreal g = color.greenF();
-    qreal b = color.blueF();
-    // Apply gamma correction (i.e. conversion to linear-space)
-    auto correct = [](qreal &v) {
-        if (v > 0.04045) {
-            v = std::pow((v + 0.055) / 1.055, 2.4);
-        } else {
-            v = v / 12.92;
-        }
-    };
-
-    correct(r);
-    correct(g);
-    correct(b);
+    qreal r;
+    qreal g;
+    qreal b;
+    linearChannels(color, r, g, b);
 
     // Observer. = 2°, Illuminant = D65
     const qreal x = r * 0.4124 + g * 0.3576 + b * 0.1805;
@@ -271,27 +368,23 @@ ColorUtils::XYZColor ColorUtils::colorToXYZ(const QColor &color)
     return XYZColor{x, y, z};
 }
 
+static qreal labPivot(qreal v)
+{
+    if (v > 0.008856) {
+        return std::pow(v, 1.0 / 3.0);
+    }
+    return (7.787 * v) + (16.0 / 116.0);
+}
+
 ColorUtils::LabColor ColorUtils::colorToLab(const QColor &color)
 {
     // First: convert to XYZ
     const auto xyz = colorToXYZ(color);
 
     // Second: convert from XYZ to L*a*b
-    qreal x = xyz.x / 0.95047; // Observer= 2°, Illuminant= D65
-    qreal y = xyz.y / 1.0;
-    qreal z = xyz.z / 1.08883;
-
-    auto pivot = [](qreal &v) {
-        if (v > 0.008856) {
-            v = std::pow(v, 1.0 / 3.0);
-        } else {
-            v = (7.787 * v) + (16.0 / 116.0);
-        }
-    };
-
-    pivot(x);
-    pivot(y);
-    pivot(z);
+    const qreal x = labPivot(xyz.x / 0.95047); // Observer= 2°, Illuminant= D65
+    const qreal y = labPivot(xyz.y / 1.0);
+    const qreal z = labPivot(xyz.z / 1.08883);
 
     LabColor labColor;
     labColor.l = std::max(0.0, (116 * y) - 16);
@@ -316,4 +409,316 @@ qreal ColorUtils::luminance(const QColor &color)
     return xyz.y;
 }
 
+qreal ColorUtils::contrastRatio(const QColor &one, const QColor &two)
+{
+    const qreal luminance1 = luminance(one);
+    const qreal luminance2 = luminance(two);
+    return (std::max(luminance1, luminance2) + 0.05) / (std::min(luminance1, luminance2) + 0.05);
+}
+
+// Luminance of an 8-bit color
+static qreal rgbLuminance(QRgb rgb)
+{
+    const auto &table = srgbToLinearTable();
+    return table[qRed(rgb)] * 0.2126 + table[qGreen(rgb)] * 0.7152 + table[qBlue(rgb)] * 0.0722;
+}
+
+QColor ColorUtils::adjustLuminance(const QColor &color, qreal minimum, qreal maximum)
+{
+    const qreal current = luminance(color);
+    if (current >= minimum && current <= maximum) {
+        return color;
+    }
+
+    const qreal h = color.hslHueF();
+    const qreal s = color.hslSaturationF();
+    // The luminance is checked on the 8-bit color which is then returned,
+    // so that the result reaches the bound and not just its unrounded lightness.
+    auto colorAt = [h, s](qreal l) {
+        return QColor::fromHslF(h, s, l).rgb();
+    };
+
+    // With hue and saturation fixed no channel decreases as lightness increases,
+    // so neither does luminance, and the lightness closest to the current one
+    // which reaches the bound can be found by bisection. 10 steps are finer than
+    // the 8-bit color the result is rounded to.
+    qreal lower;
+    qreal upper;
+    const bool lighten = current < minimum;
+    if (lighten) {
+        // The first lightness with a luminance of at least minimum is in (lower, upper]
+        lower = color.lightnessF();
+        upper = 1.0;
+    } else {
+        // The last lightness with a luminance of at most maximum is in [lower, upper)
+        lower = 0.0;
+        upper = color.lightnessF();
+    }
+    for (int i = 0; i < 10; ++i) {
+        const qreal middle = (lower + upper) / 2;
+        const qreal luminance = rgbLuminance(colorAt(middle));
+        if (lighten ? luminance >= minimum : luminance > maximum) {
+            upper = middle;
+        } else {
+            lower = middle;
+        }
+    }
+
+    QColor result = QColor::fromRgb(colorAt(lighten ? upper : lower));
+    result.setAlphaF(color.alphaF());
+    return result;
+}
+
+QColor ColorUtils::ensureContrast(const QColor &color, const QColor &background, qreal ratio)
+{
+    if (contrastRatio(color, background) >= ratio) {
+        return color;
+    }
+
+    // (lighter + 0.05) / (backgroundLuminance + 0.05) >= ratio, or
+    // (backgroundLuminance + 0.05) / (darker + 0.05) >= ratio
+    const qreal backgroundLuminance = luminance(background);
+    const qreal lighter = ratio * (backgroundLuminance + 0.05) - 0.05;
+    const qreal darker = (backgroundLuminance + 0.05) / ratio - 0.05;
+    const bool canLighten = lighter <= 1.0;
+    const bool canDarken = darker >= 0.0;
+
+    if (!canLighten && !canDarken) {
+        const QColor white = QColor::fromRgbF(1, 1, 1, color.alphaF());
+        const QColor black = QColor::fromRgbF(0, 0, 0, color.alphaF());
+        return contrastRatio(white, background) >= contrastRatio(black, background) ? white : black;
+    }
+
+    const QColor lightened = canLighten ? adjustLuminance(color, lighter, 1.0) : QColor();
+    const QColor darkened = canDarken ? adjustLuminance(color, 0.0, darker) : QColor();
+    if (!canDarken) {
+        return lightened;
+    }
+    if (!canLighten) {
+        return darkened;
+    }
+    const qreal lightness = color.lightnessF();
+    return lightened.lightnessF() - lightness <= lightness - darkened.lightnessF() ? lightened : darkened;
+}
+
+// The colors of a batch in XYZ, one array per component, so that the
+// conversions are done in one pass over the batch.
+struct XYZChannels {
+    std::vector<qreal> x;
+    std::vector<qreal> y;
+    std::vector<qreal> z;
+};
+
+// The kernels below compute 1, 2 or 4 colors at once. They multiply and add
+// in the same order as colorToXYZ() and contrastRatio(), without fused
+// multiply-adds, so all of them give the same result.
+static void linearToXYZScalar(const qreal *r, const qreal *g, const qreal *b, qreal *x, qreal *y, qreal *z, qsizetype count)
+{
+    for (qsizetype i = 0; i < count; ++i) {
+        x[i] = r[i] * 0.4124 + g[i] * 0.3576 + b[i] * 0.1805;
+        y[i] = r[i] * 0.2126 + g[i] * 0.7152 + b[i] * 0.0722;
+        z[i] = r[i] * 0.0193 + g[i] * 0.1192 + b[i] * 0.9505;
+    }
+}
+
+static void contrastRatiosScalar(qreal *luminances, qsizetype count, qreal background)
+{
+    for (qsizetype i = 0; i < count; ++i) {
+        luminances[i] = (std::max(luminances[i], background) + 0.05) / (std::min(luminances[i], background) + 0.05);
+    }
+}
+
+#ifdef __SSE2__
+static_assert(std::is_same_v<qreal, double>, "The SIMD kernels of ColorUtils work on doubles");
+
+static void linearToXYZSse2(const qreal *r, const qreal *g, const qreal *b, qreal *x, qreal *y, qreal *z, qsizetype count)
+{
+    qsizetype i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const __m128d red = _mm_loadu_pd(r + i);
+        const __m128d green = _mm_loadu_pd(g + i);
+        const __m128d blue = _mm_loadu_pd(b + i);
+        _mm_storeu_pd(x + i,
+                      _mm_add_pd(_mm_add_pd(_mm_mul_pd(red, _mm_set1_pd(0.4124)), _mm_mul_pd(green, _mm_set1_pd(0.3576))),
+                                 _mm_mul_pd(blue, _mm_set1_pd(0.1805))));
+        _mm_storeu_pd(y + i,
+                      _mm_add_pd(_mm_add_pd(_mm_mul_pd(red, _mm_set1_pd(0.2126)), _mm_mul_pd(green, _mm_set1_pd(0.7152))),
+                                 _mm_mul_pd(blue, _mm_set1_pd(0.0722))));
+        _mm_storeu_pd(z + i,
+                      _mm_add_pd(_mm_add_pd(_mm_mul_pd(red, _mm_set1_pd(0.0193)), _mm_mul_pd(green, _mm_set1_pd(0.1192))),
+                                 _mm_mul_pd(blue, _mm_set1_pd(0.9505))));
+    }
+
+    linearToXYZScalar(r + i, g + i, b + i, x + i, y + i, z + i, count - i);
+}
+
+static void contrastRatiosSse2(qreal *luminances, qsizetype count, qreal background)
+{
+    const __m128d backgroundLuminance = _mm_set1_pd(background);
+    const __m128d offset = _mm_set1_pd(0.05);
+
+    qsizetype i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const __m128d luminance = _mm_loadu_pd(luminances + i);
+        const __m128d lighter = _mm_add_pd(_mm_max_pd(luminance, backgroundLuminance), offset);
+        const __m128d darker = _mm_add_pd(_mm_min_pd(luminance, backgroundLuminance), offset);
+        _mm_storeu_pd(luminances + i, _mm_div_pd(lighter, darker));
+    }
+
+    contrastRatiosScalar(luminances + i, count - i, background);
+}
+#endif
+
+#if defined(__SSE2__) && QT_COMPILER_SUPPORTS_HERE(AVX2)
+QT_FUNCTION_TARGET(AVX2)
+static void linearToXYZAvx2(const qreal *r, const qreal *g, const qreal *b, qreal *x, qreal *y, qreal *z, qsizetype count)
+{
+    qsizetype i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m256d red = _mm256_loadu_pd(r + i);
+        const __m256d green = _mm256_loadu_pd(g + i);
+        const __m256d blue = _mm256_loadu_pd(b + i);
+        _mm256_storeu_pd(x + i,
+                         _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(red, _mm256_set1_pd(0.4124)), _mm256_mul_pd(green, _mm256_set1_pd(0.3576))),
+                                       _mm256_mul_pd(blue, _mm256_set1_pd(0.1805))));
+        _mm256_storeu_pd(y + i,
+                         _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(red, _mm256_set1_pd(0.2126)), _mm256_mul_pd(green, _mm256_set1_pd(0.7152))),
+                                       _mm256_mul_pd(blue, _mm256_set1_pd(0.0722))));
+        _mm256_storeu_pd(z + i,
+                         _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(red, _mm256_set1_pd(0.0193)), _mm256_mul_pd(green, _mm256_set1_pd(0.1192))),
+                                       _mm256_mul_pd(blue, _mm256_set1_pd(0.9505))));
+    }
+
+    linearToXYZScalar(r + i, g + i, b + i, x + i, y + i, z + i, count - i);
+}
+
+QT_FUNCTION_TARGET(AVX2)
+static void contrastRatiosAvx2(qreal *luminances, qsizetype count, qreal background)
+{
+    const __m256d backgroundLuminance = _mm256_set1_pd(background);
+    const __m256d offset = _mm256_set1_pd(0.05);
+
+    qsizetype i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m256d luminance = _mm256_loadu_pd(luminances + i);
+        const __m256d lighter = _mm256_add_pd(_mm256_max_pd(luminance, backgroundLuminance), offset);
+        const __m256d darker = _mm256_add_pd(_mm256_min_pd(luminance, backgroundLuminance), offset);
+        _mm256_storeu_pd(luminances + i, _mm256_div_pd(lighter, darker));
+    }
+
+    contrastRatiosScalar(luminances + i, count - i, background);
+}
+#endif
+
+static void linearToXYZ(const qreal *r, const qreal *g, const qreal *b, qreal *x, qreal *y, qreal *z, qsizetype count)
+{
+#if defined(__SSE2__) && QT_COMPILER_SUPPORTS_HERE(AVX2)
+    if (qCpuHasFeature(AVX2)) {
+        linearToXYZAvx2(r, g, b, x, y, z, count);
+        return;
+    }
+#endif
+#ifdef __SSE2__
+    linearToXYZSse2(r, g, b, x, y, z, count);
+#else
+    linearToXYZScalar(r, g, b, x, y, z, count);
+#endif
+}
+
+// Replaces the luminances with their contrast ratio with the background luminance
+static void luminancesToContrastRatios(qreal *luminances, qsizetype count, qreal background)
+{
+#if defined(__SSE2__) && QT_COMPILER_SUPPORTS_HERE(AVX2)
+    if (qCpuHasFeature(AVX2)) {
+        contrastRatiosAvx2(luminances, count, background);
+        return;
+    }
+#endif
+#ifdef __SSE2__
+    contrastRatiosSse2(luminances, count, background);
+#else
+    contrastRatiosScalar(luminances, count, background);
+#endif
+}
+
+static XYZChannels colorsToXYZ(const QList<QColor> &colors)
+{
+    const qsizetype count = colors.size();
+    std::vector<qreal> r(count);
+    std::vector<qreal> g(count);
+    std::vector<qreal> b(count);
+    for (qsizetype i = 0; i < count; ++i) {
+        linearChannels(colors[i], r[i], g[i], b[i]);
+    }
+
+    XYZChannels xyz{std::vector<qreal>(count), std::vector<qreal>(count), std::vector<qreal>(count)};
+    linearToXYZ(r.data(), g.data(), b.data(), xyz.x.data(), xyz.y.data(), xyz.z.data(), count);
+    return xyz;
+}
+
+QList<ColorUtils::LabColor> ColorUtils::colorsToLab(const QList<QColor> &colors)
+{
+    XYZChannels xyz = colorsToXYZ(colors);
+
+    // Same as colorToLab()
+    const qsizetype count = colors.size();
+    for (qsizetype i = 0; i < count; ++i) {
+        xyz.x[i] = labPivot(xyz.x[i] / 0.95047);
+        xyz.y[i] = labPivot(xyz.y[i] / 1.0);
+        xyz.z[i] = labPivot(xyz.z[i] / 1.08883);
+    }
+
+    QList<LabColor> labColors(count);
+    for (qsizetype i = 0; i < count; ++i) {
+        labColors[i].l = std::max(0.0, (116 * xyz.y[i]) - 16);
+        labColors[i].a = 500 * (xyz.x[i] - xyz.y[i]);
+        labColors[i].b = 200 * (xyz.y[i] - xyz.z[i]);
+    }
+    return labColors;
+}
+
+QList<qreal> ColorUtils::luminances(const QList<QColor> &colors)
+{
+    const XYZChannels xyz = colorsToXYZ(colors);
+    return QList<qreal>(xyz.y.cbegin(), xyz.y.cend());
+}
+
+QList<qreal> ColorUtils::chromas(const QList<QColor> &colors)
+{
+    const QList<LabColor> labColors = colorsToLab(colors);
+    QList<qreal> chromas(labColors.size());
+    for (qsizetype i = 0; i < labColors.size(); ++i) {
+        chromas[i] = std::sqrt(labColors[i].a * labColors[i].a + labColors[i].b * labColors[i].b);
+    }
+    return chromas;
+}
+
+QList<qreal> ColorUtils::contrastRatios(const QList<QColor> &colors, const QColor &background)
+{
+    const qreal backgroundLuminance = luminance(background);
+    QList<qreal> ratios = luminances(colors);
+    luminancesToContrastRatios(ratios.data(), ratios.size(), backgroundLuminance);
+    return ratios;
+}
+
+void ColorUtils::setCacheEnabled(bool enabled)
+{
+    s_cacheEnabled = enabled;
+}
+
+bool ColorUtils::isCacheEnabled()
+{
+    return s_cacheEnabled;
+}
+
+qint64 ColorUtils::cacheHits()
+{
+    return s_cacheHits;
+}
+
+qint64 ColorUtils::cacheMisses()
+{
+    return s_cacheMisses;
+}
+
 #include "moc_colorutils.cpp"
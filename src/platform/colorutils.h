@@ -13,6 +13,53 @@
 
 #include "kirigamiplatform_export.h"
 
+/**
+ * Adjustments of the channels of a color, for ColorUtils.adjustColor() and
+ * ColorUtils.scaleColor().
+ *
+ * These functions also accept a JavaScript object with the same properties,
+ * which has to be inspected every time they are called. Bindings which are
+ * evaluated often, e.g. in the delegates of a view, can declare the adjustment
+ * once as a property instead:
+ *
+ * @code{.qml}
+ * import QtQuick
+ * import org.kde.kirigami as Kirigami
+ *
+ * Rectangle {
+ *     readonly property Kirigami.colorAdjustment hoverAdjustment: ({ value: 20 })
+ *
+ *     color: Kirigami.ColorUtils.adjustColor(Kirigami.Theme.backgroundColor, hoverAdjustment)
+ * }
+ * @endcode
+ *
+ * @since 6.8
+ */
+struct KIRIGAMIPLATFORM_EXPORT ColorAdjustment {
+    Q_GADGET
+    QML_VALUE_TYPE(colorAdjustment)
+    QML_STRUCTURED_VALUE
+
+    Q_PROPERTY(double red MEMBER red FINAL)
+    Q_PROPERTY(double green MEMBER green FINAL)
+    Q_PROPERTY(double blue MEMBER blue FINAL)
+    Q_PROPERTY(double hue MEMBER hue FINAL)
+    Q_PROPERTY(double saturation MEMBER saturation FINAL)
+    Q_PROPERTY(double value MEMBER value FINAL)
+    Q_PROPERTY(double alpha MEMBER alpha FINAL)
+
+public:
+    double red = 0.0;
+    double green = 0.0;
+    double blue = 0.0;
+
+    double hue = 0.0;
+    double saturation = 0.0;
+    double value = 0.0;
+
+    double alpha = 0.0;
+};
+
 /**
  * Utilities for processing items to obtain colors and information useful for
  * UIs that need to adjust to variable elements.
@@ -140,6 +187,15 @@ public:
      */
     Q_INVOKABLE QColor adjustColor(const QColor &color, const QJSValue &adjustments);
 
+    /**
+     * Increases or decreases the properties of `color` by fixed amounts.
+     *
+     * Same as the overload taking a JavaScript object, see ColorAdjustment.
+     *
+     * @since 6.8
+     */
+    Q_INVOKABLE QColor adjustColor(const QColor &color, const ColorAdjustment &adjustments);
+
     /**
      * Smoothly scales colors.
      *
@@ -168,6 +224,15 @@ public:
      */
     Q_INVOKABLE QColor scaleColor(const QColor &color, const QJSValue &adjustments);
 
+    /**
+     * Smoothly scales colors.
+     *
+     * Same as the overload taking a JavaScript object, see ColorAdjustment.
+     *
+     * @since 6.8
+     */
+    Q_INVOKABLE QColor scaleColor(const QColor &color, const ColorAdjustment &adjustments);
+
     /**
      * Tint a color using a separate alpha value.
      *
@@ -196,6 +261,91 @@ public:
      */
     Q_INVOKABLE static qreal chroma(const QColor &color);
 
+    /**
+     * Returns the contrast ratio of two colors as defined by WCAG 2.
+     *
+     * The ratio ranges from 1 for identical luminances to 21 for black on white.
+     * WCAG requires at least 4.5 for text and 3 for other elements.
+     *
+     * @see https://www.w3.org/TR/WCAG21/#dfn-contrast-ratio
+     *
+     * @since 6.8
+     */
+    Q_INVOKABLE static qreal contrastRatio(const QColor &one, const QColor &two);
+
+    /**
+     * Returns the color closest to `color` which has a contrast ratio of at
+     * least `ratio` with `background`.
+     *
+     * Only the lightness of the color is changed, its hue, saturation and alpha
+     * are kept. The color is lightened or darkened, whichever changes it less,
+     * and returned unchanged if it already contrasts enough. If the ratio cannot
+     * be reached, the one of black and white which contrasts most is returned.
+     *
+     * This takes the same time whatever the colors, so it can be used in bindings.
+     *
+     * @code{.qml}
+     * import QtQuick
+     * import org.kde.kirigami as Kirigami
+     *
+     * Text {
+     *     color: Kirigami.ColorUtils.ensureContrast(accent, Kirigami.Theme.backgroundColor, 4.5)
+     * }
+     * @endcode
+     *
+     * @since 6.8
+     */
+    Q_INVOKABLE static QColor ensureContrast(const QColor &color, const QColor &background, qreal ratio);
+
+    // Not for QML, returns the color with the HSL lightness closest to the one of color whose luminance is between minimum and maximum
+    static QColor adjustLuminance(const QColor &color, qreal minimum, qreal maximum);
+
+    /**
+     * Sets whether the results of alphaBlend(), linearInterpolation() and
+     * tintWithAlpha() are kept in a small cache.
+     *
+     * These are called from bindings in the styles of most controls, with few
+     * different colors, those of the theme. With the cache enabled, changing
+     * the color scheme computes each distinct color once rather than once per
+     * binding.
+     *
+     * The setting applies to the whole application, but each thread has a
+     * cache of its own with a fixed size, so results computed on one thread,
+     * e.g. a worker thread, are not found by the others, e.g. the GUI thread.
+     *
+     * Disabled by default.
+     *
+     * @see cacheHits(), cacheMisses()
+     *
+     * @since 6.8
+     */
+    Q_INVOKABLE static void setCacheEnabled(bool enabled);
+
+    /**
+     * Returns whether the cache is enabled, see setCacheEnabled().
+     *
+     * @since 6.8
+     */
+    Q_INVOKABLE static bool isCacheEnabled();
+
+    /**
+     * Returns how many results were found in the cache since the application started.
+     *
+     * This adds up the hits of the caches of all the threads.
+     *
+     * @since 6.8
+     */
+    Q_INVOKABLE static qint64 cacheHits();
+
+    /**
+     * Returns how many results had to be computed while the cache was enabled.
+     *
+     * This adds up the misses of the caches of all the threads.
+     *
+     * @since 6.8
+     */
+    Q_INVOKABLE static qint64 cacheMisses();
+
     struct XYZColor {
         qreal x = 0;
         qreal y = 0;
@@ -215,4 +365,33 @@ public:
     static ColorUtils::LabColor colorToLab(const QColor &color);
 
     static qreal luminance(const QColor &color);
+
+    // Not for QML, same as colorToLab() for each of colors
+    static QList<ColorUtils::LabColor> colorsToLab(const QList<QColor> &colors);
+
+    /**
+     * Returns the relative luminance of each of the given colors, from 0 for
+     * black to 1 for white.
+     *
+     * Converting a whole list at once is faster than converting its colors one
+     * by one, e.g. when deriving the colors of a color scheme.
+     *
+     * @since 6.8
+     */
+    Q_INVOKABLE static QList<qreal> luminances(const QList<QColor> &colors);
+
+    /**
+     * Returns the CIELAB chroma of each of the given colors, see chroma().
+     *
+     * @since 6.8
+     */
+    Q_INVOKABLE static QList<qreal> chromas(const QList<QColor> &colors);
+
+    /**
+     * Returns the contrast ratio of each of the given colors with `background`,
+     * see contrastRatio().
+     *
+     * @since 6.8
+     */
+    Q_INVOKABLE static QList<qreal> contrastRatios(const QList<QColor> &colors, const QColor &background);
 };
@@ -8,21 +8,27 @@
 #include "platformtheme.h"
 #include "basictheme_p.h"
 #include "platformpluginfactory.h"
+#include <QCache>
 #include <QDebug>
 #include <QDir>
 #include <QGuiApplication>
+#include <QMetaMethod>
 #include <QPluginLoader>
 #include <QPointer>
 #include <QQmlContext>
 #include <QQmlEngine>
 #include <QQuickStyle>
 #include <QQuickWindow>
+#include <QtAlgorithms>
 
+#include <algorithm>
 #include <array>
 #include <cinttypes>
 #include <functional>
 #include <memory>
-#include <unordered_map>
+#include <optional>
+#include <type_traits>
+#include <utility>
 
 namespace Kirigami
 {
@@ -56,6 +62,80 @@ struct TypeInitializer {
 };
 static TypeInitializer initializer;
 
+// Identifies the data shared by themes that don't inherit, see PlatformThemePrivate::s_sharedData.
+// Platform themes may derive colors from the window, e.g. for the Inactive colorGroup,
+// so the data is only shared within a window.
+struct SharedDataKey {
+    const QMetaObject *type;
+    QQmlEngine *engine;
+    QQuickWindow *window;
+    int colorSet;
+    int colorGroup;
+
+    bool operator==(const SharedDataKey &other) const
+    {
+        return type == other.type && engine == other.engine && window == other.window && colorSet == other.colorSet && colorGroup == other.colorGroup;
+    }
+};
+
+inline size_t qHash(const SharedDataKey &key, size_t seed = 0)
+{
+    return qHashMulti(seed, key.type, key.engine, key.window, key.colorSet, key.colorGroup);
+}
+
+// Themes color their icons with the given color and their own colors, so
+// the icons of all the themes with the same colors can be shared, see
+// PlatformTheme::sharedIconFromTheme(). The colors are part of the key rather
+// than the colorSet, as they also depend on local overrides, on those of the
+// theme the data is inherited from and on whether the item is enabled. That
+// way the icons of a previous color scheme or icon theme are not found again
+// and are evicted, rather than needing to be cleared on every change.
+struct IconCacheKey {
+    const QMetaObject *type;
+    QString iconTheme;
+    QString name;
+    QRgba64 color;
+    int colorSet;
+    int colorGroup;
+    std::array<QRgba64, 20> colors;
+
+    bool operator==(const IconCacheKey &other) const
+    {
+        return type == other.type && iconTheme == other.iconTheme && name == other.name && color == other.color && colorSet == other.colorSet
+            && colorGroup == other.colorGroup && colors == other.colors;
+    }
+};
+
+inline size_t qHash(const IconCacheKey &key, size_t seed = 0)
+{
+    const size_t colors = qHashBits(key.colors.data(), sizeof(key.colors), seed);
+    return qHashMulti(colors, key.type, key.iconTheme, key.name, quint64(key.color), key.colorSet, key.colorGroup);
+}
+
+// The icons are owned by the application, so that they are not destroyed
+// after it along with other static data.
+class IconCache : public QObject
+{
+public:
+    static QCache<IconCacheKey, QIcon> *instance()
+    {
+        static QPointer<IconCache> s_instance;
+        if (!s_instance) {
+            auto app = QCoreApplication::instance();
+            s_instance = new IconCache(app);
+            connect(app, &QCoreApplication::aboutToQuit, s_instance, [cache = s_instance.data()]() {
+                cache->icons.clear();
+            });
+        }
+        return &s_instance->icons;
+    }
+
+private:
+    using QObject::QObject;
+
+    QCache<IconCacheKey, QIcon> icons{512};
+};
+
 // This class encapsulates the actual data of the Theme object. It may be shared
 // among several instances of PlatformTheme, to ensure that the memory usage of
 // PlatformTheme stays low.
@@ -65,7 +145,7 @@ class PlatformThemeData : public QObject
 
 public:
     // An enum for all colors in PlatformTheme.
-    // This is used so we can have a QHash of local overrides in the
+    // This is used so we can store only the local overrides in the
     // PlatformTheme, which avoids needing to store all these colors in
     // PlatformTheme even when they're not used.
     enum ColorRole {
@@ -95,8 +175,6 @@ public:
         ColorRoleCount,
     };
 
-    using ColorMap = std::unordered_map<std::underlying_type<ColorRole>::type, QColor>;
-
     // Which PlatformTheme instance "owns" this data object. Only the owner is
     // allowed to make changes to data.
     QPointer<PlatformTheme> owner;
@@ -109,7 +187,15 @@ public:
     QFont defaultFont;
     QFont smallFont;
 
+    // Only updated from the colors when needed, see updatedPalette().
     QPalette palette;
+    // The bits of the color roles changed since the palette was last updated.
+    uint32_t paletteChanges = 0;
+    static_assert(ColorRoleCount <= 32, "PlatformThemeData::paletteChanges can't hold all the color roles");
+
+    // Set when this data is shared by all the themes that don't inherit and
+    // have the same key.
+    std::optional<SharedDataKey> sharedKey;
 
     // A list of PlatformTheme instances that want to be notified when the data
     // changes. This is used instead of signal/slots as this way we only store
@@ -118,6 +204,14 @@ public:
     using Watcher = PlatformTheme *;
     QList<Watcher> watchers;
 
+    // Changes not yet delivered to the watchers when change batching is
+    // enabled, along with the values from before the first of them.
+    PlatformThemeChangeTracker::PropertyChanges pendingChanges;
+    PlatformTheme::ColorSet pendingColorSet = PlatformTheme::Window;
+    PlatformTheme::ColorGroup pendingColorGroup = PlatformTheme::Active;
+
+    inline static bool s_changeBatching = false;
+
     inline void setColorSet(PlatformTheme *sender, PlatformTheme::ColorSet set)
     {
         if (sender != owner || colorSet == set) {
@@ -154,7 +248,7 @@ public:
         auto oldValue = colors[role];
 
         colors[role] = color;
-        updatePalette(palette, colors);
+        paletteChanges |= 1u << role;
 
         notifyWatchers<QColor>(sender, oldValue, colors[role]);
     }
@@ -198,26 +292,100 @@ public:
     template<typename T>
     inline void notifyWatchers(PlatformTheme *sender, const T &oldValue, const T &newValue)
     {
+        if (s_changeBatching) {
+            // The sender reacts to some changes by changing the data further,
+            // like setting the colors of a new colorSet, so it is still
+            // notified right away.
+            if (watchers.contains(sender)) {
+                PlatformThemeEvents::PropertyChangedEvent<T> event(sender, oldValue, newValue);
+                QCoreApplication::sendEvent(sender, &event);
+            }
+            addPendingChange<T>(oldValue);
+            return;
+        }
+
         for (auto object : std::as_const(watchers)) {
             PlatformThemeEvents::PropertyChangedEvent<T> event(sender, oldValue, newValue);
             QCoreApplication::sendEvent(object, &event);
         }
     }
 
-    // Update a palette from a list of colors.
-    inline static void updatePalette(QPalette &palette, const std::array<QColor, ColorRoleCount> &colors)
+    template<typename T>
+    inline void addPendingChange(const T &oldValue)
+    {
+        if (!pendingChanges) {
+            QMetaObject::invokeMethod(this, &PlatformThemeData::deliverPendingChanges, Qt::QueuedConnection);
+        }
+
+        if constexpr (std::is_same_v<T, PlatformTheme::ColorSet>) {
+            if (!(pendingChanges & PlatformThemeChangeTracker::PropertyChange::ColorSet)) {
+                pendingColorSet = oldValue;
+            }
+            pendingChanges |= PlatformThemeChangeTracker::PropertyChange::ColorSet;
+        } else if constexpr (std::is_same_v<T, PlatformTheme::ColorGroup>) {
+            if (!(pendingChanges & PlatformThemeChangeTracker::PropertyChange::ColorGroup)) {
+                pendingColorGroup = oldValue;
+            }
+            pendingChanges |= PlatformThemeChangeTracker::PropertyChange::ColorGroup;
+        } else if constexpr (std::is_same_v<T, QColor>) {
+            pendingChanges |= PlatformThemeChangeTracker::PropertyChange::Color;
+        } else {
+            pendingChanges |= PlatformThemeChangeTracker::PropertyChange::Font;
+        }
+    }
+
+    // Sends one event per kind of change made since the last call to the
+    // watchers other than the owner. The events of a watcher are sent within a
+    // single change tracker so it emits its signals once.
+    inline void deliverPendingChanges()
     {
-        for (std::size_t i = 0; i < colors.size(); ++i) {
-            setPaletteColor(palette, ColorRole(i), colors.at(i));
+        const auto changes = std::exchange(pendingChanges, PlatformThemeChangeTracker::PropertyChanges{});
+        if (!changes) {
+            return;
+        }
+
+        const auto currentWatchers = watchers;
+        for (auto object : currentWatchers) {
+            if (object == owner) {
+                continue;
+            }
+
+            PlatformThemeChangeTracker tracker(object);
+
+            if (changes & PlatformThemeChangeTracker::PropertyChange::ColorSet) {
+                PlatformThemeEvents::ColorSetChangedEvent event(owner, pendingColorSet, colorSet);
+                QCoreApplication::sendEvent(object, &event);
+            }
+
+            if (changes & PlatformThemeChangeTracker::PropertyChange::ColorGroup) {
+                PlatformThemeEvents::ColorGroupChangedEvent event(owner, pendingColorGroup, colorGroup);
+                QCoreApplication::sendEvent(object, &event);
+            }
+
+            // Several colors or fonts may have changed, so these events carry
+            // no particular value.
+            if (changes & PlatformThemeChangeTracker::PropertyChange::Color) {
+                PlatformThemeEvents::ColorChangedEvent event(owner, QColor{}, QColor{});
+                QCoreApplication::sendEvent(object, &event);
+            }
+
+            if (changes & PlatformThemeChangeTracker::PropertyChange::Font) {
+                PlatformThemeEvents::FontChangedEvent event(owner, defaultFont, defaultFont);
+                QCoreApplication::sendEvent(object, &event);
+            }
         }
     }
 
-    // Update a palette from a hash of colors.
-    inline static void updatePalette(QPalette &palette, const ColorMap &colors)
+    // Colors are usually set in bulk and the palette is used far less than
+    // them, so it's only updated when used and only for the colors that changed.
+    inline const QPalette &updatedPalette()
     {
-        for (auto entry : colors) {
-            setPaletteColor(palette, ColorRole(entry.first), entry.second);
+        while (paletteChanges) {
+            const auto role = ColorRole(qCountTrailingZeroBits(paletteChanges));
+            setPaletteColor(palette, role, colors[role]);
+            paletteChanges &= paletteChanges - 1;
         }
+        return palette;
     }
 
     inline static void setPaletteColor(QPalette &palette, ColorRole role, const QColor &color)
@@ -275,30 +443,79 @@ public:
             return QColor{};
         }
 
-        QColor value = data->colors.at(color);
-
-        if (data->owner != theme && localOverrides) {
-            auto itr = localOverrides->find(color);
-            if (itr != localOverrides->end()) {
-                value = itr->second;
+        if (data->owner != theme) {
+            if (auto value = localOverride(color)) {
+                return *value;
             }
         }
 
-        return value;
+        return data->colors.at(color);
     }
 
-    inline void setColor(PlatformTheme *theme, PlatformThemeData::ColorRole color, const QColor &value)
+    inline const QColor *localOverride(PlatformThemeData::ColorRole color) const
     {
-        if (!localOverrides) {
-            localOverrides = std::make_unique<PlatformThemeData::ColorMap>();
+        if (!(localOverrideRoles & (1u << color))) {
+            return nullptr;
         }
+        return &localOverrides[localOverrideIndex(color)];
+    }
+
+    // The index of the override of a color in localOverrides, which is ordered by role.
+    inline int localOverrideIndex(PlatformThemeData::ColorRole color) const
+    {
+        return qPopulationCount(localOverrideRoles & ((1u << color) - 1));
+    }
+
+    inline void insertLocalOverride(PlatformThemeData::ColorRole color, const QColor &value)
+    {
+        const int index = localOverrideIndex(color);
+        if (localOverrideRoles & (1u << color)) {
+            localOverrides[index] = value;
+            return;
+        }
+
+        const int count = qPopulationCount(localOverrideRoles);
+        auto overrides = std::make_unique<QColor[]>(count + 1);
+        std::copy(localOverrides.get(), localOverrides.get() + index, overrides.get());
+        overrides[index] = value;
+        std::copy(localOverrides.get() + index, localOverrides.get() + count, overrides.get() + index + 1);
+
+        localOverrides = std::move(overrides);
+        localOverrideRoles |= 1u << color;
+    }
+
+    inline void removeLocalOverride(PlatformThemeData::ColorRole color)
+    {
+        const int index = localOverrideIndex(color);
+        const int count = qPopulationCount(localOverrideRoles);
+        localOverrideRoles &= ~(1u << color);
+        if (!localOverrideRoles) {
+            localOverrides.reset();
+            return;
+        }
+
+        auto overrides = std::make_unique<QColor[]>(count - 1);
+        std::copy(localOverrides.get(), localOverrides.get() + index, overrides.get());
+        std::copy(localOverrides.get() + index + 1, localOverrides.get() + count, overrides.get() + index);
+        localOverrides = std::move(overrides);
+    }
 
+    template<typename Function>
+    inline void forEachLocalOverride(Function function) const
+    {
+        uint32_t roles = localOverrideRoles;
+        for (int index = 0; roles; ++index, roles &= roles - 1) {
+            function(PlatformThemeData::ColorRole(qCountTrailingZeroBits(roles)), localOverrides[index]);
+        }
+    }
+
+    inline void setColor(PlatformTheme *theme, PlatformThemeData::ColorRole color, const QColor &value)
+    {
         if (!value.isValid()) {
             // Invalid color, assume we are resetting the value.
-            auto itr = localOverrides->find(color);
-            if (itr != localOverrides->end()) {
+            if (localOverride(color)) {
                 PlatformThemeChangeTracker tracker(theme, PlatformThemeChangeTracker::PropertyChange::Color);
-                localOverrides->erase(itr);
+                removeLocalOverride(color);
 
                 if (data) {
                     // TODO: Find a better way to determine "default" color.
@@ -312,16 +529,20 @@ public:
             return;
         }
 
-        auto itr = localOverrides->find(color);
-        if (itr != localOverrides->end() && itr->second == value && (data && data->owner != theme)) {
+        auto current = localOverride(color);
+        if (current && *current == value && (data && data->owner != theme)) {
             return;
         }
 
         PlatformThemeChangeTracker tracker(theme, PlatformThemeChangeTracker::PropertyChange::Color);
 
-        (*localOverrides)[color] = value;
+        insertLocalOverride(color, value);
 
-        if (data) {
+        if (data && data->sharedKey && !inherit) {
+            // Overrides can't go in data shared with other themes, switch to
+            // data of our own.
+            theme->update();
+        } else if (data) {
             data->setColor(theme, color, value);
         }
     }
@@ -332,11 +553,8 @@ public:
         // This is done because colorSet/colorGroup changes will trigger most
         // subclasses to reevaluate and reset the colors, breaking any local
         // overrides we have.
-        if (localOverrides) {
-            auto itr = localOverrides->find(color);
-            if (itr != localOverrides->end()) {
-                return;
-            }
+        if (localOverride(color)) {
+            return;
         }
 
         PlatformThemeChangeTracker tracker(theme, PlatformThemeChangeTracker::PropertyChange::Color);
@@ -346,6 +564,140 @@ public:
         }
     }
 
+    // The attached theme of object, if it has one. Themes look up the attached
+    // theme of many objects, qmlAttachedPropertiesObject<PlatformTheme>()
+    // resolves the attached properties function for each of them, which is
+    // most of the cost of the lookup, so it is only resolved once here.
+    inline static PlatformTheme *attachedTheme(QObject *object)
+    {
+        static QQmlAttachedPropertiesFunc function = nullptr;
+        if (!function) {
+            function = qmlAttachedPropertiesFunction(object, &PlatformTheme::staticMetaObject);
+            if (!function) {
+                return nullptr;
+            }
+        }
+        return static_cast<PlatformTheme *>(qmlAttachedPropertiesObject(object, function, false));
+    }
+
+    // Whether the data of theme can be used by its children, which is
+    // the case of data the theme owns and of shared data it does not inherit.
+    inline static bool providesData(const PlatformTheme *theme)
+    {
+        const auto &data = theme->d->data;
+        return data && (data->owner == theme || (data->sharedKey && !theme->d->inherit));
+    }
+
+    // To be called before the theme stops using its data. Only the owner of the
+    // data can change it, so when the data is shared, another theme that does
+    // not inherit it becomes the owner. If there is none, the data is no
+    // longer shared.
+    inline void releaseData(PlatformTheme *theme)
+    {
+        if (!data || !data->sharedKey || data->owner != theme) {
+            return;
+        }
+
+        data->owner = nullptr;
+        for (auto watcher : std::as_const(data->watchers)) {
+            if (watcher != theme && !watcher->d->inherit && watcher->d->data == data) {
+                data->owner = watcher;
+                return;
+            }
+        }
+
+        s_sharedData.remove(*data->sharedKey);
+        data->sharedKey.reset();
+    }
+
+    inline void setParentTheme(PlatformTheme *theme, PlatformTheme *parent)
+    {
+        if (parentTheme == parent) {
+            return;
+        }
+
+        if (parentTheme) {
+            auto &siblings = parentTheme->d->childThemes;
+            siblings->removeOne(theme);
+            if (siblings->isEmpty()) {
+                siblings.reset();
+            }
+        }
+
+        parentTheme = parent;
+
+        if (parentTheme) {
+            auto &siblings = parentTheme->d->childThemes;
+            if (!siblings) {
+                siblings = std::make_unique<QList<PlatformTheme *>>();
+            }
+            siblings->append(theme);
+        }
+    }
+
+    inline QList<PlatformTheme *> children() const
+    {
+        return childThemes ? *childThemes : QList<PlatformTheme *>();
+    }
+
+    // Themes created before a theme of one of their ancestors are children of
+    // a theme further up, which the new theme replaces as their parent. To be
+    // called once theme found its own parent theme, only its children can be
+    // below the new theme.
+    static void adoptChildThemes(PlatformTheme *theme)
+    {
+        PlatformTheme *parent = theme->d->parentTheme;
+        if (!parent) {
+            adoptChildThemes(theme, theme->parent());
+            return;
+        }
+
+        const auto siblings = parent->d->children();
+        for (auto sibling : siblings) {
+            if (sibling == theme) {
+                continue;
+            }
+            for (QObject *candidate = theme->determineParent(sibling->parent()); candidate && candidate != parent->parent();
+                 candidate = theme->determineParent(candidate)) {
+                if (candidate == theme->parent()) {
+                    sibling->d->setParentTheme(sibling, theme);
+                    sibling->update();
+                    break;
+                }
+            }
+        }
+    }
+
+    // Without a theme above the new one, the themes below it are found in the
+    // object tree, down to the first themed object of each branch.
+    static void adoptChildThemes(PlatformTheme *theme, QObject *object)
+    {
+        auto adopt = [theme](QObject *child) {
+            if (auto t = attachedTheme(child)) {
+                t->d->setParentTheme(t, theme);
+                t->update();
+            } else {
+                adoptChildThemes(theme, child);
+            }
+        };
+
+        // The reverse of determineParent(): items descend from their parent
+        // item, which is often not their parent object, e.g. for the delegates
+        // of a Repeater, other objects from their parent object.
+        if (auto item = qobject_cast<QQuickItem *>(object)) {
+            const auto childItems = item->childItems();
+            for (auto child : childItems) {
+                adopt(child);
+            }
+        }
+        const auto children = object->children();
+        for (auto child : children) {
+            if (!qobject_cast<QQuickItem *>(child)) {
+                adopt(child);
+            }
+        }
+    }
+
     /*
      * Please note that there is no q pointer. This is intentional, as it avoids
      * having to store that information for each instance of PlatformTheme,
@@ -357,9 +709,17 @@ public:
     // An instance of the data object. This is potentially shared with many
     // instances of PlatformTheme.
     std::shared_ptr<PlatformThemeData> data;
-    // Used to store color overrides of inherited data. This is created on
-    // demand and will only exist if we actually have local overrides.
-    std::unique_ptr<PlatformThemeData::ColorMap> localOverrides;
+    // Used to store color overrides of inherited data. Themes override few
+    // colors if any, so this only contains the overridden colors, ordered by
+    // role, see localOverrideRoles.
+    std::unique_ptr<QColor[]> localOverrides;
+
+    // The theme of the closest ancestor that has one, and the themes that have
+    // this one as theirs. Changes of the data only need to be propagated along
+    // these, rather than through all the objects of the tree.
+    PlatformTheme *parentTheme = nullptr;
+    // Most themes have no children, so the list is only allocated for the others
+    std::unique_ptr<QList<PlatformTheme *>> childThemes;
 
     bool inherit : 1;
     bool supportsIconColoring : 1; // TODO KF6: Remove in favour of virtual method
@@ -374,20 +734,36 @@ public:
     uint8_t colorSet : 4;
     uint8_t colorGroup : 4;
 
+    // The bits of the colors in localOverrides. This fits in the padding
+    // after the above fields.
+    uint32_t localOverrideRoles = 0;
+    static_assert(PlatformThemeData::ColorRoleCount <= 32, "PlatformThemePrivate::localOverrideRoles can't hold all the color roles");
+
     // Ensure the above assumption holds. Should this static assert fail, the
     // bit size above needs to be adjusted.
     static_assert(PlatformTheme::ColorGroupCount <= 16, "PlatformTheme::ColorGroup contains more elements than can be stored in PlatformThemePrivate");
     static_assert(PlatformTheme::ColorSetCount <= 16, "PlatformTheme::ColorSet contains more elements than can be stored in PlatformThemePrivate");
 
     inline static PlatformPluginFactory *s_pluginFactory = nullptr;
+
+    // Themes that don't inherit their data and have no local overrides share it
+    // with all the other themes of the same type, engine, colorSet and
+    // colorGroup. Lists with delegates using e.g. the View colorSet then only
+    // need a single data object rather than one per delegate.
+    inline static QHash<SharedDataKey, std::weak_ptr<PlatformThemeData>> s_sharedData;
 };
 
+// Every themed item has one, benchmark_platformtheme measures what it costs
+// beyond this.
+static_assert(sizeof(PlatformThemePrivate) <= 5 * sizeof(void *) + 8, "PlatformThemePrivate should stay small");
+
 PlatformTheme::PlatformTheme(QObject *parent)
     : QObject(parent)
     , d(new PlatformThemePrivate)
 {
     if (QQuickItem *item = qobject_cast<QQuickItem *>(parent)) {
         connect(item, &QQuickItem::windowChanged, this, [this](QQuickWindow *window) {
+            // An ancestor was reparented, possibly below another theme
             if (window) {
                 update();
             }
@@ -401,14 +777,28 @@ PlatformTheme::PlatformTheme(QObject *parent)
     }
 
     update();
+
+    if (parent) {
+        PlatformThemePrivate::adoptChildThemes(this);
+    }
 }
 
 PlatformTheme::~PlatformTheme()
 {
     if (d->data) {
+        d->releaseData(this);
         d->data->removeChangeWatcher(this);
     }
 
+    // The themes below this one now have the theme above it as closest theme
+    auto grandParent = d->parentTheme;
+    d->setParentTheme(this, nullptr);
+    const auto children = d->children();
+    for (auto child : children) {
+        child->d->parentTheme = nullptr;
+        child->d->setParentTheme(child, grandParent);
+    }
+
     delete d;
 }
 
@@ -417,7 +807,10 @@ void PlatformTheme::setColorSet(PlatformTheme::ColorSet colorSet)
     PlatformThemeChangeTracker tracker(this, PlatformThemeChangeTracker::PropertyChange::ColorSet);
     d->colorSet = colorSet;
 
-    if (d->data) {
+    if (d->data && d->data->sharedKey) {
+        // Switch to the shared data of the new colorSet
+        update();
+    } else if (d->data) {
         d->data->setColorSet(this, colorSet);
     }
 }
@@ -432,7 +825,10 @@ void PlatformTheme::setColorGroup(PlatformTheme::ColorGroup colorGroup)
     PlatformThemeChangeTracker tracker(this, PlatformThemeChangeTracker::PropertyChange::ColorGroup);
     d->colorGroup = colorGroup;
 
-    if (d->data) {
+    if (d->data && d->data->sharedKey) {
+        // Switch to the shared data of the new colorGroup
+        update();
+    } else if (d->data) {
         d->data->setColorGroup(this, colorGroup);
     }
 }
@@ -823,11 +1219,11 @@ QPalette PlatformTheme::palette() const
         return QPalette{};
     }
 
-    auto palette = d->data->palette;
+    auto palette = d->data->updatedPalette();
 
-    if (d->localOverrides) {
-        PlatformThemeData::updatePalette(palette, *d->localOverrides);
-    }
+    d->forEachLocalOverride([&palette](PlatformThemeData::ColorRole role, const QColor &color) {
+        PlatformThemeData::setPaletteColor(palette, role, color);
+    });
 
     return palette;
 }
@@ -839,6 +1235,28 @@ QIcon PlatformTheme::iconFromTheme(const QString &name, const QColor &customColo
     return icon;
 }
 
+QIcon PlatformTheme::sharedIconFromTheme(const QString &name, const QColor &customColor)
+{
+    if (!QCoreApplication::instance()) {
+        return iconFromTheme(name, customColor);
+    }
+
+    IconCacheKey key{metaObject(), QIcon::themeName(), name, customColor.rgba64(), colorSet(), colorGroup(), {}};
+    static_assert(PlatformThemeData::ColorRoleCount == std::tuple_size_v<decltype(key.colors)>, "IconCacheKey::colors can't hold all the color roles");
+    for (int role = 0; role < PlatformThemeData::ColorRoleCount; ++role) {
+        key.colors[role] = d->color(this, PlatformThemeData::ColorRole(role)).rgba64();
+    }
+
+    auto cache = IconCache::instance();
+    if (auto icon = cache->object(key)) {
+        return *icon;
+    }
+
+    QIcon icon = iconFromTheme(name, customColor);
+    cache->insert(key, new QIcon(icon));
+    return icon;
+}
+
 bool PlatformTheme::supportsIconColoring() const
 {
     return d->supportsIconColoring;
@@ -849,6 +1267,16 @@ void PlatformTheme::setSupportsIconColoring(bool support)
     d->supportsIconColoring = support;
 }
 
+void PlatformTheme::setChangeBatchingEnabled(bool enabled)
+{
+    PlatformThemeData::s_changeBatching = enabled;
+}
+
+bool PlatformTheme::isChangeBatchingEnabled()
+{
+    return PlatformThemeData::s_changeBatching;
+}
+
 PlatformTheme *PlatformTheme::qmlAttachedProperties(QObject *object)
 {
     QQmlEngine *engine = qmlEngine(object);
@@ -892,8 +1320,9 @@ void PlatformTheme::emitSignalsForChanges(int changes)
         Q_EMIT colorsChanged();
     }
 
-    if (propertyChanges & PlatformThemeChangeTracker::PropertyChange::Palette) {
-        Q_EMIT paletteChanged(d->data->palette);
+    // Avoid building the palette when nothing uses it
+    if ((propertyChanges & PlatformThemeChangeTracker::PropertyChange::Palette) && isSignalConnected(QMetaMethod::fromSignal(&PlatformTheme::paletteChanged))) {
+        Q_EMIT paletteChanged(palette());
     }
 
     if (propertyChanges & PlatformThemeChangeTracker::PropertyChange::Font) {
@@ -902,7 +1331,7 @@ void PlatformTheme::emitSignalsForChanges(int changes)
     }
 
     if (propertyChanges & PlatformThemeChangeTracker::PropertyChange::Data) {
-        updateChildren(parent());
+        updateChildren();
     }
 }
 
@@ -958,39 +1387,88 @@ void PlatformTheme::update()
     auto oldData = d->data;
 
     bool actualInherit = d->inherit;
+    bool enabled = true;
     if (QQuickItem *item = qobject_cast<QQuickItem *>(parent())) {
+        enabled = item->isEnabled();
         // For inactive windows it should work already, as also the non inherit themes get it
-        if (colorGroup() != Disabled && !item->isEnabled()) {
+        if (colorGroup() != Disabled && !enabled) {
             actualInherit = false;
         }
     }
 
+    // The closest theme among the ancestors. The current parent theme is
+    // kept if no themed object came in between, as a theme still being
+    // constructed is not available as attached object yet, see adoptChildThemes().
+    PlatformTheme *parentTheme = nullptr;
+    for (QObject *candidate = determineParent(parent()); candidate; candidate = determineParent(candidate)) {
+        if (d->parentTheme && candidate == d->parentTheme->parent()) {
+            parentTheme = d->parentTheme;
+            break;
+        }
+        parentTheme = PlatformThemePrivate::attachedTheme(candidate);
+        if (parentTheme) {
+            break;
+        }
+    }
+
+    d->setParentTheme(this, parentTheme);
+
+    // When inheriting, find the theme providing the data to use
+    PlatformTheme *dataOwner = nullptr;
     if (actualInherit) {
-        QObject *candidate = parent();
-        while (true) {
-            candidate = determineParent(candidate);
-            if (!candidate) {
+        for (auto t = parentTheme; t; t = t->d->parentTheme) {
+            if (PlatformThemePrivate::providesData(t)) {
+                dataOwner = t;
                 break;
             }
+        }
+    }
 
-            auto t = static_cast<PlatformTheme *>(qmlAttachedPropertiesObject<PlatformTheme>(candidate, false));
-            if (t && t->d->data && t->d->data->owner == t) {
-                if (d->data == t->d->data) {
-                    // Inheritance is already correct, do nothing.
-                    return;
-                }
+    if (dataOwner) {
+        if (d->data == dataOwner->d->data) {
+            // Inheritance is already correct, do nothing.
+            return;
+        }
 
-                d->data = t->d->data;
+        d->releaseData(this);
+        d->data = dataOwner->d->data;
 
-                PlatformThemeEvents::DataChangedEvent event{this, oldData, t->d->data};
-                QCoreApplication::sendEvent(this, &event);
+        PlatformThemeEvents::DataChangedEvent event{this, oldData, dataOwner->d->data};
+        QCoreApplication::sendEvent(this, &event);
 
-                return;
-            }
+        return;
+    }
+
+    // Disabled items get their colors adjusted, they can't share their data.
+    const bool shareData = !d->inherit && enabled && !d->localOverrideRoles;
+    if (shareData) {
+        auto item = qobject_cast<QQuickItem *>(parent());
+        const SharedDataKey key{metaObject(), qmlEngine(parent()), item ? item->window() : nullptr, d->colorSet, d->colorGroup};
+        auto data = PlatformThemePrivate::s_sharedData.value(key).lock();
+        if (data && data == d->data) {
+            return;
+        }
+
+        d->releaseData(this);
+        if (!data) {
+            data = std::make_shared<PlatformThemeData>();
+            data->owner = this;
+            data->setColorSet(this, static_cast<ColorSet>(d->colorSet));
+            data->setColorGroup(this, static_cast<ColorGroup>(d->colorGroup));
+            data->sharedKey = key;
+            PlatformThemePrivate::s_sharedData.insert(key, data);
         }
-    } else if (d->data && d->data->owner != this) {
-        // Inherit has changed and we no longer want to inherit, clear the data
-        // so it is recreated below.
+        d->data = data;
+
+        PlatformThemeEvents::DataChangedEvent event{this, oldData, d->data};
+        QCoreApplication::sendEvent(this, &event);
+        return;
+    }
+
+    if (d->data && (d->data->sharedKey || (!actualInherit && d->data->owner != this))) {
+        // Inherit has changed and we no longer want to inherit, or we can no
+        // longer share the data, clear the data so it is recreated below.
+        d->releaseData(this);
         d->data = nullptr;
     }
 
@@ -1001,30 +1479,20 @@ void PlatformTheme::update()
         d->data->setColorGroup(this, static_cast<ColorGroup>(d->colorGroup));
     }
 
-    if (d->localOverrides) {
-        for (auto entry : *d->localOverrides) {
-            d->data->setColor(this, PlatformThemeData::ColorRole(entry.first), entry.second);
-        }
-    }
+    d->forEachLocalOverride([this](PlatformThemeData::ColorRole role, const QColor &color) {
+        d->data->setColor(this, role, color);
+    });
 
     PlatformThemeEvents::DataChangedEvent event{this, oldData, d->data};
     QCoreApplication::sendEvent(this, &event);
 }
 
-void PlatformTheme::updateChildren(QObject *object)
+void PlatformTheme::updateChildren()
 {
-    if (!object) {
-        return;
-    }
-
-    const auto children = object->children();
+    // Updating a child may move it elsewhere in the tree of themes
+    const auto children = d->children();
     for (auto child : children) {
-        auto t = static_cast<PlatformTheme *>(qmlAttachedPropertiesObject<PlatformTheme>(child, false));
-        if (t) {
-            t->update();
-        } else {
-            updateChildren(child);
-        }
+        child->update();
     }
 }
 
@@ -275,6 +275,19 @@ public:
     // this will be used by desktopicon to fetch icons with KIconLoader
     virtual Q_INVOKABLE QIcon iconFromTheme(const QString &name, const QColor &customColor = Qt::transparent);
 
+    /**
+     * Returns the icon iconFromTheme() returns for @p name and @p customColor,
+     * shared with all the themes of the same type and colors.
+     *
+     * The same icons with the same colors are used all over an application,
+     * e.g. by the buttons of toolbars, sharing them means they are only
+     * resolved and rasterized once. Icons of another icon theme or other
+     * colors, including local overrides, are not shared.
+     *
+     * @since 6.8
+     */
+    QIcon sharedIconFromTheme(const QString &name, const QColor &customColor = Qt::transparent);
+
     bool supportsIconColoring() const;
 
     // foreground colors
@@ -307,6 +320,31 @@ public:
     // QML attached property
     static PlatformTheme *qmlAttachedProperties(QObject *object);
 
+    /**
+     * Sets whether changes of a theme reach the themes inheriting from it in
+     * batches.
+     *
+     * By default, every change of a color, font, colorSet or colorGroup is
+     * immediately sent to all the themes that inherit it. When a color scheme
+     * changes, every theme owning its data sets all of its colors, so large
+     * user interfaces process hundreds of events per theme. With batching
+     * enabled, the changes are collected and delivered to the inheriting themes
+     * once per event loop iteration, which then emit their change signals once.
+     * The theme that made the changes is still notified immediately.
+     *
+     * This applies to the whole application and is disabled by default.
+     *
+     * @since 6.8
+     */
+    Q_INVOKABLE static void setChangeBatchingEnabled(bool enabled);
+
+    /**
+     * Returns whether changes are delivered in batches, see setChangeBatchingEnabled().
+     *
+     * @since 6.8
+     */
+    Q_INVOKABLE static bool isChangeBatchingEnabled();
+
 Q_SIGNALS:
     void colorsChanged();
     void defaultFontChanged(const QFont &font);
@@ -354,7 +392,7 @@ protected:
 
 private:
     KIRIGAMIPLATFORM_NO_EXPORT void update();
-    KIRIGAMIPLATFORM_NO_EXPORT void updateChildren(QObject *item);
+    KIRIGAMIPLATFORM_NO_EXPORT void updateChildren();
     KIRIGAMIPLATFORM_NO_EXPORT QObject *determineParent(QObject *object);
     KIRIGAMIPLATFORM_NO_EXPORT void emitSignalsForChanges(int changes);
 
@@ -645,7 +645,7 @@ QImage Icon::iconPixmap(const QIcon &icon) const
 QIcon Icon::loadFromTheme(const QString &iconName) const
 {
     const QColor tintColor = !m_color.isValid() || m_color == Qt::transparent ? (m_selected ? m_theme->highlightedTextColor() : m_theme->textColor()) : m_color;
-    return m_theme->iconFromTheme(iconName, tintColor);
+    return m_theme->sharedIconFromTheme(iconName, tintColor);
 }
 
 void Icon::updatePaintedGeometry()
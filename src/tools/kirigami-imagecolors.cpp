@@ -0,0 +1,125 @@
+/*
+ *  SPDX-FileCopyrightText: 2026 KDE Contributors
+ *
+ *  SPDX-License-Identifier: LGPL-2.0-or-later
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QRegularExpression>
+#include <QTextStream>
+
+#include "imagecolorsdiskcache.h"
+#include "imagecolorsengine.h"
+
+// Computes the palettes of the images of a directory and stores them in its sidecar
+static int processDirectory(const QString &directory, const QStringList &nameFilters, const QSize &analysisSize, ImageColorsEngine::Quantizer quantizer)
+{
+    QTextStream out(stdout);
+    ImageColorsDiskCache sidecar(ImageColorsDiskCache::sidecarFileName(directory));
+    PaletteWorkspace workspace;
+
+    int count = 0;
+    const QStringList files = QDir(directory).entryList(nameFilters, QDir::Files, QDir::Name);
+    for (const QString &file : files) {
+        const QString path = QDir(directory).filePath(file);
+        const QString key = ImageColorsDiskCache::sidecarKey(path, analysisSize, quantizer);
+        if (sidecar.find(key)) {
+            continue;
+        }
+
+        const QImage image = ImageColorsEngine::loadImage(path, analysisSize);
+        if (image.isNull()) {
+            out << "Could not read " << path << Qt::endl;
+            continue;
+        }
+        sidecar.insert(key, ImageColorsEngine::generatePalette(image, quantizer, {}, &workspace));
+        ++count;
+    }
+
+    out << directory << ": " << count << " new palettes" << Qt::endl;
+    return count;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("kirigami-imagecolors"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QStringLiteral("Precomputes the palettes ImageColors extracts from the images of directories, "
+                       "so applications don't have to compute them at runtime."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("directories"), QStringLiteral("The directories containing the images."), QStringLiteral("[directories...]"));
+
+    const QCommandLineOption sizeOption(QStringLiteral("size"),
+                                        QStringLiteral("The analysis size, must match ImageColors.analysisSize (default: 128x128)."),
+                                        QStringLiteral("WIDTHxHEIGHT"),
+                                        QStringLiteral("128x128"));
+    const QCommandLineOption quantizerOption(QStringLiteral("quantizer"),
+                                             QStringLiteral("The quantizer, must match ImageColors.quantizer: clustering or histogram (default: clustering)."),
+                                             QStringLiteral("quantizer"),
+                                             QStringLiteral("clustering"));
+    const QCommandLineOption recursiveOption({QStringLiteral("r"), QStringLiteral("recursive")}, QStringLiteral("Also process subdirectories."));
+    const QCommandLineOption rebuildOption(QStringLiteral("rebuild"), QStringLiteral("Discard existing sidecar files instead of adding to them."));
+    parser.addOptions({sizeOption, quantizerOption, recursiveOption, rebuildOption});
+    parser.process(app);
+
+    const auto sizeMatch = QRegularExpression(QStringLiteral("^(\\d+)x(\\d+)$")).match(parser.value(sizeOption));
+    if (!sizeMatch.hasMatch()) {
+        qCritical("Invalid size: %s", qPrintable(parser.value(sizeOption)));
+        return 1;
+    }
+    const QSize analysisSize(sizeMatch.captured(1).toInt(), sizeMatch.captured(2).toInt());
+
+    ImageColorsEngine::Quantizer quantizer;
+    if (parser.value(quantizerOption) == QLatin1String("clustering")) {
+        quantizer = ImageColorsEngine::Clustering;
+    } else if (parser.value(quantizerOption) == QLatin1String("histogram")) {
+        quantizer = ImageColorsEngine::Histogram;
+    } else {
+        qCritical("Invalid quantizer: %s", qPrintable(parser.value(quantizerOption)));
+        return 1;
+    }
+
+    if (parser.positionalArguments().isEmpty()) {
+        parser.showHelp(1);
+    }
+
+    QStringList nameFilters;
+    const auto formats = QImageReader::supportedImageFormats();
+    for (const QByteArray &format : formats) {
+        nameFilters << QStringLiteral("*.") + QString::fromLatin1(format);
+    }
+
+    QStringList directories;
+    for (const QString &argument : parser.positionalArguments()) {
+        const QString directory = QDir(argument).absolutePath();
+        if (!QFileInfo(directory).isDir()) {
+            qCritical("Not a directory: %s", qPrintable(argument));
+            return 1;
+        }
+        directories << directory;
+        if (parser.isSet(recursiveOption)) {
+            QDirIterator it(directory, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                directories << it.next();
+            }
+        }
+    }
+
+    for (const QString &directory : std::as_const(directories)) {
+        if (parser.isSet(rebuildOption)) {
+            QFile::remove(ImageColorsDiskCache::sidecarFileName(directory));
+        }
+        processDirectory(directory, nameFilters, analysisSize, quantizer);
+    }
+
+    return 0;
+}